@@ -2,20 +2,31 @@
 
 #include "application_layer.h"
 #include "link_layer.h"
+#include "link_layer_ext.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // strlen
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdbool.h>
 #include "statistics.h"
-
-// Control packet types
-#define C_START 1
-#define C_DATA  2
-#define C_END   3
-
-#define T_FILE_SIZE 0
-#define T_FILE_NAME 1
+#include "link_config.h"
+#include "frame_sizer.h"
+#include "compressor.h"
+#include "compress_pool.h"
+#include "receive_journal.h"
+#include "fcs.h"
+#include "file_batch.h"
+#include "file_digest.h"
+#include "write_behind.h"
+#include "prefetch.h"
+#include "profiler.h"
+#include "stats_shm.h"
+#include "delta_sync.h"
+#include "trace.h"
+#include "packet_types.h"
+#include <unistd.h>
+#include <fcntl.h>
 
 // =================================================================
 // Packet Construction Functions
@@ -56,6 +67,238 @@ int buildControlPacket( unsigned char *packet, unsigned char controlType, const
 
 }
 
+/**
+ * @brief Appends a TLV to a control packet.
+ *
+ * @param packet Pointer to the packet being built.
+ * @param index Current size of the packet.
+ * @return The new size of the packet.
+ */
+
+int appendTlv(unsigned char *packet, int index, unsigned char type, const void *value, int length)
+{
+    packet[index++] = type;
+    packet[index++] = length;
+    memcpy(&packet[index], value, length);
+    return index + length;
+}
+
+// Bytes of the start and of the end of a file that go into its identity
+#define IDENTITY_SAMPLE_SIZE (64 * 1024)
+
+/**
+ * @brief Identity of a file for resuming: CRC-32C of its size, modification time
+ * and first and last IDENTITY_SAMPLE_SIZE bytes.
+ *
+ * It only has to tell a different file apart; the kept bytes themselves are
+ * checked by the digest at END. Reading two blocks instead of the whole file
+ * keeps START from waiting for a full read of a large file.
+ *
+ * @param data The file contents (mapped).
+ * @param st The file status (size and st_mtim).
+ */
+
+uint32_t fileIdentity(const unsigned char *data, const struct stat *st)
+{
+    long long size = st->st_size;
+    long long mtimeNs = (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+
+    FcsState state;
+    initFcs(&state, FCS_CRC32C);
+    updateFcs(&state, (const unsigned char *)&size, sizeof(size));
+    updateFcs(&state, (const unsigned char *)&mtimeNs, sizeof(mtimeNs));
+    long long head = (size < IDENTITY_SAMPLE_SIZE) ? size : IDENTITY_SAMPLE_SIZE;
+    if (head > 0) updateFcs(&state, data, head);
+    long long tail = (size - head < IDENTITY_SAMPLE_SIZE) ? size - head : IDENTITY_SAMPLE_SIZE;
+    if (tail > 0) updateFcs(&state, data + size - tail, tail);
+
+    unsigned char crc[4];
+    finishFcs(&state, crc);
+    uint32_t id;
+    memcpy(&id, crc, 4);
+    return id;
+}
+
+/**
+ * @brief Adds data of any size to a digest (updateDigest takes an int size).
+ */
+
+void updateDigestLong(DigestState *state, const unsigned char *data, long long size)
+{
+    for (long long done = 0; done < size; done += 1 << 30) {
+        long long n = size - done;
+        updateDigest(state, data + done, (n > (1 << 30)) ? (1 << 30) : n);
+    }
+}
+
+/**
+ * @brief XXH64 of a whole file (see file_digest.h).
+ *
+ * @param data The file contents (mapped).
+ * @param size The file size.
+ */
+
+uint64_t digestOfData(const unsigned char *data, long long size)
+{
+    DigestState state;
+    initDigest(&state);
+    updateDigestLong(&state, data, size);
+    return finishDigest(&state);
+}
+
+/**
+ * @brief Adds the first size bytes written to a received file, read back from disk, to a digest.
+ *
+ * @param state The digest.
+ * @param file The received file (every write flushed).
+ * @param size Bytes to read back from the start.
+ * @return 0 on success, -1 on error.
+ */
+
+int digestWrittenData(DigestState *state, FILE *file, long long size)
+{
+    if (size == 0) return 0;
+    unsigned char *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    updateDigestLong(state, data, size);
+    munmap(data, size);
+    return 0;
+}
+
+/**
+ * @brief XXH64 of what was written to a received file, read back from disk.
+ *
+ * @param file The received file (every write flushed).
+ * @param size Its size.
+ * @param value Receives the digest.
+ * @return 0 on success, -1 on error.
+ */
+
+int digestOfWrittenFile(FILE *file, long long size, uint64_t *value)
+{
+    DigestState state;
+    initDigest(&state);
+    if (digestWrittenData(&state, file, size) < 0) return -1;
+    *value = finishDigest(&state);
+    return 0;
+}
+
+/**
+ * @brief Builds only the header of a data packet: C | L2 | L1.
+ *
+ * Used by the transmitter, which sends the header and the file data as
+ * separate blocks (see llwritev) instead of copying both into one packet.
+ *
+ * @param header Pointer to a buffer of at least 3 bytes.
+ * @param dataSize The size of the data that follows (K).
+ * @return The size of the header (3).
+ */
+
+int buildDataHeader(unsigned char *header, int dataSize) {
+    header[0] = C_DATA;
+
+    header[1] = dataSize / 256;  // L2 MSB
+    header[2] = dataSize % 256;  // L1 LSB
+
+    return 3;
+}
+
+/**
+ * @brief Builds the header of a compressed data packet.
+ *
+ * The packet structure is: C (1 byte: C_DATA_COMPRESSED) | L2 | L1 | O2 | O1 | Compressed data (K bytes)
+ * K = L2*256 + L1 is the compressed size and O = O2*256 + O1 the size of the file data it holds.
+ *
+ * @param header Pointer to a buffer of at least 5 bytes.
+ * @param compressedSize The size of the compressed data (K).
+ * @param originalSize The number of file bytes it decompresses to.
+ * @return The size of the header (5).
+ */
+
+int buildCompressedHeader(unsigned char *header, int compressedSize, int originalSize) {
+    header[0] = C_DATA_COMPRESSED;
+
+    header[1] = compressedSize / 256;
+    header[2] = compressedSize % 256;
+    header[3] = originalSize / 256;
+    header[4] = originalSize % 256;
+
+    return 5;
+}
+
+/**
+ * @brief Builds the header of the data packet for a block from the compression pool.
+ *
+ * When both ends agreed on offset-addressed data (linkConfig.offsetData) the
+ * packet is a C_DATA_AT or C_DATA_COMPRESSED_AT, with the file offset of the
+ * data after C: C | Offset (8 bytes) | L2 | L1 (| O2 | O1 when compressed).
+ * Otherwise it is a C_DATA or C_DATA_COMPRESSED packet.
+ *
+ * @param header Pointer to a buffer of at least MAX_DATA_HEADER_SIZE bytes.
+ * @param block The block to send.
+ * @param offset The offset of the block in the file (or in the stream of a batch).
+ * @return The size of the header.
+ */
+
+int buildBlockHeader(unsigned char *header, const CompressJob *block, long long offset) {
+    if (!linkConfig.offsetData) {
+        return block->compressed ? buildCompressedHeader(header, block->outputSize, block->inputSize)
+                                 : buildDataHeader(header, block->inputSize);
+    }
+
+    int index = 0;
+    header[index++] = block->compressed ? C_DATA_COMPRESSED_AT : C_DATA_AT;
+    memcpy(&header[index], &offset, 8);
+    index += 8;
+
+    int length = block->compressed ? block->outputSize : block->inputSize;
+    header[index++] = length / 256;
+    header[index++] = length % 256;
+    if (block->compressed) {
+        header[index++] = block->inputSize / 256;
+        header[index++] = block->inputSize % 256;
+    }
+    return index;
+}
+
+/**
+ * @brief Number of compression workers requested in the environment.
+ *
+ * LL_COMPRESS=1 turns compression on with one worker per online CPU;
+ * LL_COMPRESS_THREADS sets the number of workers explicitly.
+ *
+ * @return The number of workers (at most MAX_COMPRESS_THREADS), 0 if compression is off.
+ */
+
+int compressionThreads() {
+    const char *enabled = getenv("LL_COMPRESS");
+    if (enabled == NULL || strcmp(enabled, "1") != 0) return 0;
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *count = getenv("LL_COMPRESS_THREADS");
+    if (count != NULL) threads = atoi(count);
+
+    if (threads < 1) threads = 1;
+    if (threads > MAX_COMPRESS_THREADS) threads = MAX_COMPRESS_THREADS;
+    return threads;
+}
+
+/**
+ * @brief TRUE if the environment asks for delta transfers (LL_DELTA=1).
+ *
+ * The transmitter then offers the receiver to send only what its old copy of
+ * the file lacks (see delta_sync.h).
+ */
+
+bool deltaRequested() {
+    const char *enabled = getenv("LL_DELTA");
+    return enabled != NULL && strcmp(enabled, "1") == 0;
+}
+
 /**
  * @brief Builds a data packet.
  *
@@ -70,10 +313,7 @@ int buildControlPacket( unsigned char *packet, unsigned char controlType, const
  */
 
 int buildDataPacket(unsigned char *packet, unsigned char *data, int dataSize) {
-    packet[0] = C_DATA;
-
-    packet[1] = dataSize / 256;  // L2 MSB
-    packet[2] = dataSize % 256;  // L1 LSB
+    buildDataHeader(packet, dataSize);
     /*
         Data
     */
@@ -82,6 +322,49 @@ int buildDataPacket(unsigned char *packet, unsigned char *data, int dataSize) {
     return 3 + dataSize; 
 }
 
+/**
+ * @brief Writes a block of received file data. Runs on the writer thread (see write_behind.h).
+ *
+ * In a batch session the data is split over the files of the manifest.
+ * Otherwise it is placed at its offset in the file opened by START (pwrite),
+ * so blocks need not arrive in order, and the journal is brought up to date
+ * with the part of the file that is now complete.
+ *
+ * @param context Pointer to the receiver's FILE pointer.
+ * @return 0 on success, -1 on error.
+ */
+
+int writeFileData(void *context, long long offset, const unsigned char *data, int size) {
+    if (batchStarted()) return writeBatchData(offset, data, size);
+
+    FILE *file = *(FILE **)context;
+    for (int done = 0; done < size; ) {
+        ssize_t written = pwrite(fileno(file), data + done, size - done, offset + done);
+        if (written < 0) {
+            perror("RX: ERROR ->  Failed to write data to file");
+            return -1;
+        }
+        done += written;
+    }
+    return commitJournal(markWritten(offset, size), FALSE);
+}
+
+/**
+ * @brief Hands the file data of a received data packet to the writer and adds it to the digest.
+ *
+ * @return 0 on success, -1 if an earlier write failed.
+ */
+
+int writeReceivedData(DigestState *digest, long long offset, const unsigned char *data, int size) {
+    PROFILE_BEGIN(PROF_FILE_IO);
+    updateDigest(digest, data, size);
+    // The writer thread splits a batch block over the files; stats stay on this thread
+    if (batchStarted()) countBatchData(size);
+    int result = queueWrite(offset, data, size);
+    PROFILE_END(PROF_FILE_IO);
+    return result;
+}
+
 // =================================================================
 // Main Application Logic
 // =================================================================
@@ -107,6 +390,10 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
 {
     printf("The file name needs to have less than 256 characters");
 
+    // Log level and event ring (LL_LOG, LL_TRACE_FILE)
+    initTrace(role);
+    initStatsShm(role);
+
     // Determination of the Role
     LinkLayerRole roleLink;
     roleLink = (strcmp(role, "tx") == 0) ? LlTx : LlRx;
@@ -121,25 +408,22 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
     strncpy(linkLayer.serialPort, serialPort, 50);
     linkLayer.serialPort[49] = '\0';
 
+    // Started before llopen so the SET/UA exchange is counted
+    initStatistics();
+    stats.baudRate = baudRate;
+    PROFILE_BEGIN(PROF_SETUP);
     int correct_Open = llopen(linkLayer);
+    PROFILE_END(PROF_SETUP);
     
     if (correct_Open != -1) {
         // Connection established
 
-        initStatistics();
+        markTransferStart();
 
         if (roleLink == LlTx) {
 // =====================================================
 // TRANSMITTER LOGIC
 // =====================================================           
-            /*
-                Opening the File
-            */
-           FILE *file = fopen(filename, "rb");
-            if (!file) {
-                perror("fopen");
-                return;
-            }
             /*
                 File Size assignment
             */
@@ -149,27 +433,202 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                 return;
             }
             long long int fileSize = st.st_size;
+            FILE *file = NULL;
+            unsigned char *fileData = NULL;
+
+            // File bytes per data packet: the agreed payload minus the data packet header
+            int maxChunkSize = linkConfig.maxPayload - (linkConfig.offsetData ? DATA_AT_HEADER_SIZE : DATA_HEADER_SIZE);
+
+            /*
+                A directory is sent as a batch: all its files over this connection
+            */
+            bool batch = S_ISDIR(st.st_mode);
+            if (batch) {
+                int nFiles = openBatch(filename, maxChunkSize, &fileSize);
+                if (nFiles < 0) {
+                    printf("TX: ERROR -> Could not read the directory \"%s\"\n", filename);
+                    return;
+                }
+                printf("TX: Batch of %d files (%lld bytes)\n", nFiles, fileSize);
+            }
+            /*
+                Opening the File
+            */
+            else if ((file = fopen(filename, "rb")) == NULL) {
+                perror("fopen");
+                return;
+            }
 
+            /*
+                The file is mapped and the I-frames are built straight from the mapping
+            */
+            if (!batch && fileSize > 0) {
+                fileData = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+                if (fileData == MAP_FAILED) {
+                    perror("mmap");
+                    fclose(file);
+                    return;
+                }
+                madvise(fileData, fileSize, MADV_SEQUENTIAL);
+                posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+                addPrefetchRegion(fileData, fileSize);
+            }
+
+            // Control packets only; data packets are sent as header + file slice
             unsigned char packet[MAX_PAYLOAD_SIZE];
-            unsigned char fileBuffer[MAX_PAYLOAD_SIZE - 3]; // Without C , L1 , L2
+            unsigned char header[MAX_DATA_HEADER_SIZE]; // C (, Offset) , L2 , L1 (, O2 , O1 when compressed)
+            initFrameSizer(maxChunkSize, baudRate, nTries);
+
+            /*
+                Blocks are compressed by the workers ahead of the one being sent
+            */
+            stats.compressionThreads = compressionThreads();
+            if (initCompressPool(stats.compressionThreads, maxChunkSize, 2) < 0) {
+                printf("TX: ERROR -> Could not start the compression workers\n");
+                stopPrefetch();
+                if (fileData != NULL) munmap(fileData, fileSize);
+                if (file != NULL) fclose(file);
+                closeBatch();
+                return;
+            }
+            long long int bytesQueued = 0;
             long long int bytesSum = 0;
             int sequenceNumber = 0; // Not really needed - Optional
             bool error = FALSE;    
             int packetSize;
 
-            /*
-                Start Control Packet
-            */
-            packetSize =  buildControlPacket(packet, C_START, "penguin-received.gif", fileSize);
-            int isWriten = llwrite(packet, packetSize);
+            int isWriten;
+            if (batch) {
+                /*
+                    Manifest of the batch, in as many packets as needed
+                */
+                int manifestSize = (linkConfig.maxPayload < sizeof(packet)) ? linkConfig.maxPayload : sizeof(packet);
+                while ((packetSize = buildManifestPacket(packet, manifestSize)) > 0) {
+                    if (llwrite(packet, packetSize) < 0) {
+                        packetSize = -1;
+                        break;
+                    }
+                }
+                isWriten = packetSize;
+            } else {
+                /*
+                    Start Control Packet
+                */
+                packetSize =  buildControlPacket(packet, C_START, "penguin-received.gif", fileSize);
+                // Only a receiver that can answer START can resume, so only it needs the identity
+                if (linkConfig.replyFrames) {
+                    uint32_t fileId = fileIdentity(fileData, &st);
+                    packetSize = appendTlv(packet, packetSize, T_FILE_ID, &fileId, 4);
+                }
+                // A delta needs the reply frames for the signatures and offsets to place the data
+                if (deltaRequested() && linkConfig.replyFrames && linkConfig.offsetData) {
+                    unsigned char canDelta = 1;
+                    packetSize = appendTlv(packet, packetSize, T_DELTA, &canDelta, 1);
+                }
+                isWriten = llwrite(packet, packetSize);
+            }
             if ( isWriten < 0 ){
                 printf("TX: Error in the llwrite Start\n");
-                if(fclose(file) < 0){
+                freeCompressPool();
+                stopPrefetch();
+                if (fileData != NULL) munmap(fileData, fileSize);
+                if(file != NULL && fclose(file) < 0){
                     perror("TX: Closing File in Start Control Packet");
                 }
+                closeBatch();
                 return;
             }
-            printf("TX: Start Control Packet sent\n");
+            printf(batch ? "TX: Manifest sent\n" : "TX: Start Control Packet sent\n");
+
+            /*
+                The receiver answers START with the number of bytes it already has,
+                or with the blocks of its old copy of the file for a delta
+            */
+            long long int resumeOffset = 0;
+            uint32_t deltaBlockSize = 0;
+            uint32_t deltaBlocks = 0;
+            unsigned char reply[MAX_REPLY_SIZE];
+            if (linkConfig.replyFrames && !batch) {
+                int replySize = llreadreply(reply);
+                if (replySize <= 0 || reply[0] != C_START) {
+                    printf("TX: ERROR -> No answer to the Start Control Packet\n");
+                    error = TRUE;
+                }
+                for (int index = 1; !error && index + 2 <= replySize; ) {
+                    unsigned char T = reply[index++];
+                    unsigned char L = reply[index++];
+                    if (T == T_OFFSET && L == 8 && index + 8 <= replySize) {
+                        memcpy(&resumeOffset, &reply[index], 8);
+                    }
+                    else if (T == T_BLOCK_SIZE && L == 4 && index + 4 <= replySize) {
+                        memcpy(&deltaBlockSize, &reply[index], 4);
+                    }
+                    else if (T == T_BLOCK_COUNT && L == 4 && index + 4 <= replySize) {
+                        memcpy(&deltaBlocks, &reply[index], 4);
+                    }
+                    index += L;
+                }
+                if (resumeOffset < 0 || resumeOffset > fileSize) {
+                    printf("TX: ERROR -> Invalid resume offset %lld\n", resumeOffset);
+                    error = TRUE;
+                } else if (resumeOffset > 0) {
+                    printf("TX: Receiver already has %lld bytes, resuming from there\n", resumeOffset);
+                }
+            }
+            bytesQueued = bytesSum = resumeOffset;
+            long long int rangeEnd = fileSize;  // End of the stretch of the file being queued
+
+            /*
+                Delta: the signatures of the receiver's blocks follow in more replies.
+                The blocks found in the file are sent as references, the rest as data
+            */
+            bool delta = FALSE;
+            if (!error && deltaBlocks > 0) {
+                printf("TX: Receiver has an old copy: %u blocks of %u bytes\n", deltaBlocks, deltaBlockSize);
+                int added = expectSignatures(deltaBlockSize, deltaBlocks);
+                while (added == 0) {
+                    int replySize = llreadreply(reply);
+                    added = (replySize < 0) ? -1 : addSignatures(reply, replySize);
+                }
+                if (added < 0) {
+                    printf("TX: ERROR -> Could not get the block signatures\n");
+                    error = TRUE;
+                } else {
+                    delta = TRUE;
+                    stats.deltaBlocks = deltaBlocks;
+                    stats.deltaReusedBytes = planDelta(fileData, fileSize);
+                    printf("TX: %lld bytes found in the receiver's copy\n", stats.deltaReusedBytes);
+
+                    int copySize = (linkConfig.maxPayload < sizeof(packet)) ? linkConfig.maxPayload : sizeof(packet);
+                    long long int covered;
+                    while (!error && (packetSize = buildCopyPacket(packet, copySize, &covered)) > 0) {
+                        if (llwrite(packet, packetSize) < 0) {
+                            printf("TX: Error in writing COPY\n");
+                            error = TRUE;
+                        }
+                        bytesSum += covered;
+                    }
+                    // The data packets start with the first stretch that is not in the copy
+                    rangeEnd = 0;
+                }
+            }
+
+            // Digest of the whole file, checked by the receiver at END: the bytes it
+            // already had on a resume are hashed here, the rest as they are sent
+            DigestState digest;
+            initDigest(&digest);
+            if (!delta && resumeOffset > 0) {
+                PROFILE_BEGIN(PROF_FILE_IO);
+                updateDigestLong(&digest, fileData, resumeOffset);
+                PROFILE_END(PROF_FILE_IO);
+            }
+
+            /*
+                A prefetch thread reads the file ahead of the blocks being queued
+            */
+            if (startPrefetch(bytesQueued) < 0) {
+                printf("TX: WARNING -> Sending without read-ahead\n");
+            }
 
             /*
                 Data packets
@@ -177,38 +636,65 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
             printf("\nTX: Starting file transfer...\n");
 
             while(!error){
-                int bytesRead = fread(fileBuffer, 1, sizeof(fileBuffer), file);
-                
-                if ( bytesRead <= 0 ){
-                    if (feof(file)) {
-                        printf("TX: End of file reached\n");
-                        break;
-                    } else {
-                        perror("fread");
-                        error = TRUE;
-                        break;
-                    }
+                while (compressPoolHasRoom()) {
+                    if (bytesQueued == rangeEnd && !(delta && nextLiteralRange(&bytesQueued, &rangeEnd))) break;
+                    int blockSize = nextChunkSize();
+                    if (blockSize > rangeEnd - bytesQueued) blockSize = rangeEnd - bytesQueued;
+                    submitBlock(batch ? nextBatchBlock(blockSize) : fileData + bytesQueued, blockSize);
+                    bytesQueued += blockSize;
                 }
+                advancePrefetch(bytesQueued);
 
-                bytesSum+= bytesRead;
-                sequenceNumber++;
+                const CompressJob *block = waitBlock();
+                if (block == NULL) {
+                    printf("TX: End of file reached\n");
+                    break;
+                }
 
-                packetSize = buildDataPacket(packet, fileBuffer, bytesRead);
+                struct iovec iov[2];
+                iov[0].iov_base = header;
+                iov[0].iov_len = buildBlockHeader(header, block, batch ? bytesSum : block->input - fileData);
+                if (block->compressed) {
+                    iov[1].iov_base = block->output;
+                    iov[1].iov_len = block->outputSize;
+                    stats.packetsCompressed++;
+                    stats.compressedInputBytes += block->inputSize;
+                } else {
+                    iov[1].iov_base = (void *)block->input;
+                    iov[1].iov_len = block->inputSize;
+                }
+                PROFILE_BEGIN(PROF_FILE_IO);
+                updateDigest(&digest, block->input, block->inputSize);
+                PROFILE_END(PROF_FILE_IO);
 
-                isWriten = llwrite(packet, packetSize);
+                bytesSum+= block->inputSize;
+                stats.payloadBytes += iov[1].iov_len;
+                sequenceNumber++;
+
+                isWriten = llwritev(iov, 2);
+                TRACE_EVENT(EV_PACKET_SENT, 0, 0, iov[0].iov_len + iov[1].iov_len, header[0]);
+                releaseBlock();
                 if( isWriten < 0){
                     printf("TX: Error in writing DATA\n");
                     error = TRUE;
                     break;
                 }
 
-                printf("TX: Progress: %lld/%lld bytes (%.1f%%)\n", bytesSum, fileSize, (bytesSum * 100.0) / fileSize);
+                stats.progressBytes = bytesSum;
+                stats.progressTotal = fileSize;
+                traceProgress("TX", bytesSum, fileSize);
             }
 
+            freeCompressPool();
+            stopPrefetch();
+            freeDelta();
+
             // Check for errors
             if (error) {
                 printf("\nTX: ERROR - File transfer failed\n");
-                if(fclose(file) < 0){
+                if (fileData != NULL) munmap(fileData, fileSize);
+                closeBatch();
+                if(file != NULL && fclose(file) < 0){
                     perror("TX: Closing File in Start Control Packet");
                 }
                 if(llclose() < 0){
@@ -225,7 +711,13 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                 End Control Packet
             */
 
-            packetSize =  buildControlPacket(packet, C_END, "penguin-received.gif", bytesSum);
+            packetSize =  buildControlPacket(packet, C_END, batch ? filename : "penguin-received.gif", bytesSum);
+            // After a delta the receiver checks the whole file it rebuilt
+            uint64_t digestValue = delta ? digestOfData(fileData, fileSize) : finishDigest(&digest);
+            packetSize = appendTlv(packet, packetSize, T_DIGEST, &digestValue, 8);
+            if (fileData != NULL) munmap(fileData, fileSize);
+            closeBatch();
+            printf("TX: File digest (XXH64) %016llx\n", (unsigned long long)digestValue);
             isWriten = llwrite(packet, packetSize);
             if ( isWriten < 0 ){
                 printf("TX: Error in the llwrite End\n");
@@ -233,11 +725,16 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
             }
             printf("TX: End Control Packet sent\n");
 
-            stats.totalDataBytes = bytesSum;
-            printStatistics("TRANSMITTER");
+            stats.totalDataBytes = bytesSum - resumeOffset;
+            markTransferEnd();
 
-            fclose(file);
-            if (llclose() < 0) {
+            if (file != NULL) fclose(file);
+            // Printed after llclose, so the DISC exchange is included
+            PROFILE_BEGIN(PROF_TEARDOWN);
+            int closed = llclose();
+            PROFILE_END(PROF_TEARDOWN);
+            printStatistics("TRANSMITTER");
+            if (closed < 0) {
                 printf("ERROR: Failed to close connection\n");
                 return;
             }
@@ -248,7 +745,8 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
 // =====================================================
 // RECEIVER LOGIC
 // =====================================================
-            unsigned char packet[MAX_PAYLOAD_SIZE];
+            static unsigned char packet[MAX_LINK_PAYLOAD_SIZE];
+            static unsigned char block[MAX_LINK_PAYLOAD_SIZE]; // Decompressed data packet
             FILE *file = NULL;
             long long int fileSize = 0;
             long long int bytesReceived = 0; 
@@ -256,13 +754,29 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
             bool transferComplete = FALSE;  
             bool error = FALSE;    
             char rxfilename[256] = {0};       
+            uint32_t fileId = 0;
+            bool hasFileId = FALSE;
+            long long int resumeOffset = 0;
+            bool wantsDelta = FALSE;    // The transmitter can send a delta
+            bool delta = FALSE;         // It does: the file is rebuilt in partname from the old copy
+            char partname[300] = {0};
+            DigestState digest;
+            initDigest(&digest);
+
+            /*
+                File data is written by a writer thread, so disk stalls do not hold back the acknowledgements
+            */
+            if (startWriter(writeFileData, &file, MAX_LINK_PAYLOAD_SIZE) < 0) {
+                printf("RX: ERROR -> Could not start the writer thread\n");
+                error = TRUE;
+            }
 
             /*
                 We keep reading packets till the end pakcet or an error
             */
             while (!transferComplete && !error) { 
                 
-                printf("Rx: Waiting for next packet...\n");
+                logFrame("Rx: Waiting for next packet...\n");
                 int bytesRead = llread(packet);
                 if (bytesRead < 0) {
                     printf("RX: ERROR -> llread failed\n");
@@ -271,7 +785,8 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                 }
                 
                 unsigned char C = packet[0];
-                printf("Rx: Received packet type: %d\n", C);
+                TRACE_EVENT(EV_PACKET_RECEIVED, 0, 0, bytesRead, C);
+                logFrame("Rx: Received packet type: %d\n", C);
                 
                 switch (C) {
                     case C_START:
@@ -299,57 +814,246 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                                 memcpy(&rxfilename, &packet[index], L);
                                 rxfilename[L] = '\0';
                                 printf("RX: File name is \"%s\"\n", rxfilename);
-                                /*
-                                    It should create the file with the rxfilename 
-                                    or Destroy the existing file with the rxfilename and have a brand file named rxfilename
-                                */
-                                file = fopen(rxfilename, "wb");
+                            }
+                            else if (T == T_FILE_ID && L == 4) {
+                                memcpy(&fileId, &packet[index], 4);
+                                hasFileId = TRUE;
+                            }
+                            else if (T == T_DELTA && L == 1) {
+                                wantsDelta = packet[index] != 0;
+                            }
+                            /*
+                                Advancing L characters that were mentioned above
+                            */
+                            index += L;
+                        }
+
+                        if (hasFileId && linkConfig.replyFrames) {
+                            /*
+                                An old copy of the file (not a partial transfer) is the base of a delta:
+                                it stays untouched while the new file is rebuilt next to it
+                            */
+                            int deltaBlocks = 0;
+                            if (wantsDelta && linkConfig.offsetData && !hasJournal(rxfilename)) {
+                                deltaBlocks = openBasis(rxfilename);
+                            }
+                            if (deltaBlocks > 0) {
+                                snprintf(partname, sizeof(partname), "%s.part", rxfilename);
+                                file = fopen(partname, "w+b");   // Read back for the digest
                                 if (!file) {
                                     perror("fopen");
                                     error = TRUE;
                                     break;
                                 }
+                                delta = TRUE;
+                                stats.deltaBlocks = deltaBlocks;
+                                printf("RX: Old copy of \"%s\" found: %d blocks of %u bytes\n",
+                                       rxfilename, deltaBlocks, basisBlockSize());
                             }
                             /*
-                                Advancing L characters that were mentioned above
+                                Keep what a previous transfer of the same file left on disk,
+                                and tell the transmitter where to continue
                             */
-                            index += L;
+                            else if (openJournal(rxfilename, fileSize, fileId, &file, &resumeOffset) < 0) {
+                                error = TRUE;
+                                break;
+                            }
+                            bytesReceived = resumeOffset;
+                            if (resumeOffset > 0) {
+                                printf("RX: Resuming \"%s\" at byte %lld\n", rxfilename, resumeOffset);
+                                // The digest at END covers the whole file, the kept bytes included
+                                PROFILE_BEGIN(PROF_FILE_IO);
+                                int readBack = digestWrittenData(&digest, file, resumeOffset);
+                                PROFILE_END(PROF_FILE_IO);
+                                if (readBack < 0) {
+                                    error = TRUE;
+                                    break;
+                                }
+                            }
+
+                            unsigned char reply[MAX_REPLY_SIZE];
+                            int replySize = 0;
+                            reply[replySize++] = C_START;
+                            replySize = appendTlv(reply, replySize, T_OFFSET, &resumeOffset, 8);
+                            if (delta) {
+                                uint32_t blockSize = basisBlockSize();
+                                uint32_t blockCount = deltaBlocks;
+                                replySize = appendTlv(reply, replySize, T_BLOCK_SIZE, &blockSize, 4);
+                                replySize = appendTlv(reply, replySize, T_BLOCK_COUNT, &blockCount, 4);
+                            }
+                            if (llreply(reply, replySize) < 0) {
+                                error = TRUE;
+                                break;
+                            }
+                            // The signatures of the blocks, in as many replies as needed
+                            while (delta && (replySize = buildSignatureReply(reply, sizeof(reply))) > 0) {
+                                if (llreply(reply, replySize) < 0) {
+                                    error = TRUE;
+                                    break;
+                                }
+                            }
+                            if (delta) printf("RX: Block signatures sent\n");
+                        } else {
+                            /*
+                                It should create the file with the rxfilename 
+                                or Destroy the existing file with the rxfilename and have a brand file named rxfilename
+                            */
+                            file = fopen(rxfilename, "wb");
+                            if (!file) {
+                                perror("fopen");
+                                error = TRUE;
+                                break;
+                            }
                         }
+                        // Reserve the disk space for the rest of the file in one go
+                        preallocateFile(file, fileSize);
+                        break;
+
+                    case C_MANIFEST:
+                        /*
+                            Manifest of a batch: the files go into the directory named on the command line
+                        */
+                        printf("RX: Manifest packet recived\n");
+                        if (file != NULL || addManifestEntries(filename, packet, bytesRead) < 0) {
+                            error = TRUE;
+                            break;
+                        }
+                        fileSize = batchTotalSize();
                         break;
                         
                     case C_DATA:  
+                    case C_DATA_AT:
                         /*
                             Data Packet
                         */
-                        printf("RX: Data packet recived\n");
+                        logFrame("RX: Data packet recived\n");
                         
-                        if (!file) {
+                        if (!file && !batchStarted()) {
                             printf("RX: ERROR -> Received DATA before START!\n");
                             error = TRUE;
                             break;
                         }
+                        /*
+                            A C_DATA_AT packet says where its data goes; a C_DATA one follows the previous data
+                        */
+                        long long int offset = bytesReceived;
+                        int at = 1;    // Position of L2
+                        if (C == C_DATA_AT) {
+                            memcpy(&offset, &packet[1], 8);
+                            at = 9;
+                        }
                         /*
                             Math to get the K octets
                         */
-                        int L2 = packet[1];
-                        int L1 = packet[2];
+                        int L2 = packet[at];
+                        int L1 = packet[at + 1];
                         int K = 256 * L2 + L1;
+                        if (at + 2 + K > bytesRead || offset < 0 || offset + K > fileSize) {
+                            printf("RX: ERROR -> Invalid data packet (%d bytes at %lld)\n", K, offset);
+                            error = TRUE;
+                            break;
+                        }
                         
-                        size_t written = fwrite(&packet[3], 1, K, file);
-                        if (written != K) {
-                            printf("RX: ERROR ->  Failed to write data to file\n");
+                        if (writeReceivedData(&digest, offset, &packet[at + 2], K) < 0) {
                             error = TRUE;
                             break;
                         }
                         bytesReceived += K;
+                        stats.payloadBytes += K;
                         sequenceNumber++;
-                        printf("RX: Data written: \"%d\" bytes\n", K);
+                        logFrame("RX: Data queued: \"%d\" bytes\n", K);
                         /*
                             %lld -> long long int -> 1 long long int = GB
                         */
-                        printf("RX: Progress: %lld/%lld (%.1f%%)\n", bytesReceived, fileSize, (bytesReceived * 100.0) / fileSize);
+                        stats.progressBytes = bytesReceived;
+                        stats.progressTotal = fileSize;
+                        traceProgress("RX", bytesReceived, fileSize);
+                        break;
+
+                    case C_DATA_COMPRESSED:
+                    case C_DATA_COMPRESSED_AT:
+                        /*
+                            Compressed Data Packet
+                        */
+                        logFrame("RX: Compressed data packet recived\n");
+
+                        if (!file && !batchStarted()) {
+                            printf("RX: ERROR -> Received DATA before START!\n");
+                            error = TRUE;
+                            break;
+                        }
+
+                        offset = bytesReceived;
+                        at = 1;
+                        if (C == C_DATA_COMPRESSED_AT) {
+                            memcpy(&offset, &packet[1], 8);
+                            at = 9;
+                        }
+                        int compressedSize = 256 * packet[at] + packet[at + 1];
+                        int originalSize = 256 * packet[at + 2] + packet[at + 3];
+                        if (compressedSize > bytesRead - (at + 4) || offset < 0 || offset + originalSize > fileSize ||
+                            decompressBlock(&packet[at + 4], compressedSize, block, sizeof(block)) != originalSize) {
+                            printf("RX: ERROR -> Invalid compressed data packet\n");
+                            error = TRUE;
+                            break;
+                        }
+
+                        if (writeReceivedData(&digest, offset, block, originalSize) < 0) {
+                            error = TRUE;
+                            break;
+                        }
+                        bytesReceived += originalSize;
+                        stats.payloadBytes += compressedSize;
+                        stats.packetsCompressed++;
+                        stats.compressedInputBytes += originalSize;
+                        sequenceNumber++;
+                        logFrame("RX: Data queued: \"%d\" bytes (%d compressed)\n", originalSize, compressedSize);
+                        stats.progressBytes = bytesReceived;
+                        stats.progressTotal = fileSize;
+                        traceProgress("RX", bytesReceived, fileSize);
                         break;
                 
+                    case C_COPY:
+                        /*
+                            Copy Packet: blocks of the old copy that go to the new file
+                        */
+                        logFrame("RX: Copy packet recived\n");
+
+                        if (!delta) {
+                            printf("RX: ERROR -> Received COPY without an old copy\n");
+                            error = TRUE;
+                            break;
+                        }
+                        for (index = 1; !error && index + COPY_ENTRY_SIZE <= bytesRead; index += COPY_ENTRY_SIZE) {
+                            uint32_t first, count;
+                            long long int length = 0;
+                            memcpy(&offset, &packet[index], 8);
+                            memcpy(&first, &packet[index + 8], 4);
+                            memcpy(&count, &packet[index + 12], 4);
+                            const unsigned char *source = basisBlocks(first, count, &length);
+                            if (source == NULL || offset < 0 || offset + length > fileSize) {
+                                printf("RX: ERROR -> Invalid copy (%u blocks from %u to %lld)\n", count, first, offset);
+                                error = TRUE;
+                                break;
+                            }
+                            // In pieces the writer's buffers can hold
+                            PROFILE_BEGIN(PROF_FILE_IO);
+                            for (long long int done = 0; done < length; done += MAX_LINK_PAYLOAD_SIZE) {
+                                long long int piece = length - done;
+                                if (queueWrite(offset + done, source + done, (piece > MAX_LINK_PAYLOAD_SIZE) ? MAX_LINK_PAYLOAD_SIZE : piece) < 0) {
+                                    error = TRUE;
+                                    break;
+                                }
+                            }
+                            PROFILE_END(PROF_FILE_IO);
+                            bytesReceived += length;
+                            stats.deltaReusedBytes += length;
+                        }
+                        stats.progressBytes = bytesReceived;
+                        stats.progressTotal = fileSize;
+                        traceProgress("RX", bytesReceived, fileSize);
+                        break;
+
                     case C_END:  
                          /*
                             End Control Packet
@@ -359,6 +1063,8 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                         index = 1;
                         long long int endFileSize = 0;
                         char endrxfilename[256] = {0};
+                        uint64_t endDigest = 0;
+                        bool hasDigest = FALSE;
                         while (index < bytesRead) {
                             unsigned char T = packet[index++];
                             unsigned char L = packet[index++];
@@ -370,12 +1076,33 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                                 memcpy(&endrxfilename, &packet[index], L);
                                 endrxfilename[L] = '\0';
                             }
+                            else if (T == T_DIGEST && L == 8) {
+                                memcpy(&endDigest, &packet[index], 8);
+                                hasDigest = TRUE;
+                            }
                             index += L;
                         }
+                        // Everything queued must be on disk before the file is checked
+                        PROFILE_BEGIN(PROF_FILE_IO);
+                        if (flushWrites() < 0) {
+                            error = TRUE;
+                        }
+                        PROFILE_END(PROF_FILE_IO);
+
                         /*
                             It should be equal to the Start
                         */
-                        if (endFileSize != fileSize) {
+                        if (batchStarted()) {
+                            if (endFileSize != fileSize) {
+                                printf("RX: ERROR -> END size (%lld) != manifest size (%lld)\n", endFileSize, fileSize);
+                                error = TRUE;
+                            }
+                            else if (!batchComplete()) {
+                                printf("RX: ERROR -> Batch incomplete (%lld/%lld bytes)\n", bytesReceived, fileSize);
+                                error = TRUE;
+                            }
+                        }
+                        else if (endFileSize != fileSize) {
                             printf("RX: ERROR -> END file size (%lld) != START file size (%lld)\n", endFileSize, fileSize);
                             error = TRUE;
                         } 
@@ -392,7 +1119,51 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                             error = TRUE;
                         }
 
-                        stats.totalDataBytes = bytesReceived;
+                        /*
+                            The digest of what was written must match the transmitter's
+                            (a transmitter without digests does not send it)
+                        */
+                        bool corrupt = FALSE;   // The data on disk is not the transmitter's
+                        if (!error && hasDigest) {
+                            uint64_t digestValue = finishDigest(&digest);
+                            // The blocks copied from the old copy did not go through the digest:
+                            // the rebuilt file is read back instead
+                            PROFILE_BEGIN(PROF_FILE_IO);
+                            int readBack = delta ? digestOfWrittenFile(file, fileSize, &digestValue) : 0;
+                            PROFILE_END(PROF_FILE_IO);
+                            if (readBack < 0) {
+                                error = TRUE;
+                            }
+                            else if (digestValue != endDigest) {
+                                printf("RX: ERROR -> File digest %016llx != transmitter's %016llx\n",
+                                       (unsigned long long)digestValue, (unsigned long long)endDigest);
+                                error = TRUE;
+                                corrupt = TRUE;
+                            } else {
+                                printf("RX: File digest (XXH64) %016llx verified\n", (unsigned long long)digestValue);
+                            }
+                        }
+
+                        stats.totalDataBytes = bytesReceived - resumeOffset;
+
+                        if (file != NULL) fclose(file);
+                        file = NULL;
+                        // A resume must not keep data that failed the check
+                        if (corrupt) discardJournal();
+                        else closeJournal(!error);
+                        freeBatch();
+
+                        /*
+                            The rebuilt file takes the place of the old copy
+                        */
+                        if (delta) {
+                            closeBasis();
+                            if (!error && rename(partname, rxfilename) < 0) {
+                                perror("RX: ERROR ->  Failed to replace the old copy");
+                                error = TRUE;
+                            }
+                            if (error) unlink(partname);
+                        }
 
                         printf("RX: File donwloaded with sucess\n");
                         /*
@@ -403,10 +1174,14 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                         printf("\n========================================\n\n");
                         */
                        
-                        printStatistics("RECEIVER");
+                        markTransferEnd();
 
                         transferComplete = TRUE; 
-                        if (llclose() < 0) {
+                        PROFILE_BEGIN(PROF_TEARDOWN);
+                        int closed = llclose();
+                        PROFILE_END(PROF_TEARDOWN);
+                        printStatistics("RECEIVER");
+                        if (closed < 0) {
                             printf("ERROR: Failed to close connection\n");
                             return;
                         }
@@ -419,6 +1194,19 @@ void applicationLayer(const char *serialPort, const char *role, int baudRate,
                         break;
                 }
             }
+
+            if (error && file != NULL) {
+                // What arrived is kept for the next attempt
+                flushWrites();
+                commitJournal(writtenPrefix(), TRUE);
+                closeJournal(FALSE);
+                fclose(file);
+                // A delta starts over from the old copy, which is still there
+                if (delta) unlink(partname);
+            }
+            stopWriter();
+            closeBasis();
+            freeBatch();
         }
     } else {
         /*
@@ -0,0 +1,231 @@
+// Byte stuffing encoder implementation
+
+#include "byte_stuffing.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+// Above this many escapes per block, a byte loop beats copying the runs in between
+#define SPARSE_ESCAPES 2
+
+/**
+ * @brief Writes the bytes of a block that contains FLAG/ESC.
+ *
+ * When the block has few escapes, the runs between the bytes flagged in "mask"
+ * are copied as they are. Dense blocks (e.g. a payload full of 0x7E) are
+ * written byte by byte. Each flagged byte is replaced by ESC, byte ^ 0x20.
+ *
+ * @param dst Output position.
+ * @param src Start of the block.
+ * @param blockSize Number of bytes in the block.
+ * @param mask Bit i set if src[i] must be escaped.
+ * @return The number of bytes written.
+ */
+static int stuffBlock(unsigned char *dst, const unsigned char *src, int blockSize, unsigned int mask)
+{
+    int out = 0;
+    int pos = 0;
+
+    if (__builtin_popcount(mask) > SPARSE_ESCAPES) {
+        for (int i = 0; i < blockSize; i++) {
+            if (mask & (1u << i)) {
+                dst[out++] = STUFF_ESC;
+                dst[out++] = src[i] ^ 0x20;
+            } else {
+                dst[out++] = src[i];
+            }
+        }
+        return out;
+    }
+
+    while (mask != 0) {
+        int bit = __builtin_ctz(mask);
+        memcpy(dst + out, src + pos, bit - pos);
+        out += bit - pos;
+        dst[out++] = STUFF_ESC;
+        dst[out++] = src[bit] ^ 0x20;
+        pos = bit + 1;
+        mask &= mask - 1;
+    }
+
+    memcpy(dst + out, src + pos, blockSize - pos);
+    return out + blockSize - pos;
+}
+
+/**
+ * @brief Portable kernel: one byte at a time.
+ */
+int stuffBytesScalar(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    unsigned char acc = 0;
+    int out = 0;
+
+    for (int i = 0; i < size; i++) {
+        unsigned char byte = src[i];
+        acc ^= byte;
+        if (byte == STUFF_FLAG || byte == STUFF_ESC) {
+            dst[out++] = STUFF_ESC;
+            dst[out++] = byte ^ 0x20;
+        } else {
+            dst[out++] = byte;
+        }
+    }
+
+    if (bcc != NULL) *bcc ^= acc;
+    return out;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * @brief SSE2 kernel: 16 bytes per step.
+ *
+ * Blocks without FLAG/ESC (the common case) are stored with a single unaligned
+ * store; the XOR is accumulated in a vector register and folded at the end.
+ */
+int stuffBytesSSE2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    const __m128i flag = _mm_set1_epi8((char)STUFF_FLAG);
+    const __m128i esc = _mm_set1_epi8((char)STUFF_ESC);
+    __m128i acc = _mm_setzero_si128();
+    int out = 0;
+    int i = 0;
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        acc = _mm_xor_si128(acc, v);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, flag), _mm_cmpeq_epi8(v, esc));
+        unsigned int mask = _mm_movemask_epi8(special);
+
+        if (mask == 0) {
+            _mm_storeu_si128((__m128i *)(dst + out), v);
+            out += 16;
+        } else if (mask == 0xFFFF) {
+            // Every byte escaped: interleave ESC with byte ^ 0x20
+            __m128i escaped = _mm_xor_si128(v, _mm_set1_epi8(0x20));
+            _mm_storeu_si128((__m128i *)(dst + out), _mm_unpacklo_epi8(esc, escaped));
+            _mm_storeu_si128((__m128i *)(dst + out + 16), _mm_unpackhi_epi8(esc, escaped));
+            out += 32;
+        } else {
+            out += stuffBlock(dst + out, src + i, 16, mask);
+        }
+    }
+
+    unsigned char lanes[16];
+    unsigned char x = 0;
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    for (int k = 0; k < 16; k++) x ^= lanes[k];
+
+    out += stuffBytesScalar(dst + out, src + i, size - i, &x);
+    if (bcc != NULL) *bcc ^= x;
+    return out;
+}
+
+/**
+ * @brief AVX2 kernel: 32 bytes per step, same structure as the SSE2 one.
+ */
+__attribute__((target("avx2")))
+int stuffBytesAVX2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    const __m256i flag = _mm256_set1_epi8((char)STUFF_FLAG);
+    const __m256i esc = _mm256_set1_epi8((char)STUFF_ESC);
+    __m256i acc = _mm256_setzero_si256();
+    int out = 0;
+    int i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        acc = _mm256_xor_si256(acc, v);
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(v, flag), _mm256_cmpeq_epi8(v, esc));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+
+        if (mask == 0) {
+            _mm256_storeu_si256((__m256i *)(dst + out), v);
+            out += 32;
+        } else if (mask == 0xFFFFFFFFu) {
+            // Every byte escaped: interleave ESC with byte ^ 0x20 (unpack works per
+            // 128-bit lane, so the lanes are put back in order before storing)
+            __m256i escaped = _mm256_xor_si256(v, _mm256_set1_epi8(0x20));
+            __m256i lo = _mm256_unpacklo_epi8(esc, escaped);
+            __m256i hi = _mm256_unpackhi_epi8(esc, escaped);
+            _mm256_storeu_si256((__m256i *)(dst + out), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(dst + out + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+            out += 64;
+        } else {
+            out += stuffBlock(dst + out, src + i, 32, mask);
+        }
+    }
+
+    unsigned char lanes[32];
+    unsigned char x = 0;
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    for (int k = 0; k < 32; k++) x ^= lanes[k];
+
+    out += stuffBytesScalar(dst + out, src + i, size - i, &x);
+    if (bcc != NULL) *bcc ^= x;
+    return out;
+}
+
+#else
+
+int stuffBytesSSE2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    return stuffBytesScalar(dst, src, size, bcc);
+}
+
+int stuffBytesAVX2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    return stuffBytesScalar(dst, src, size, bcc);
+}
+
+#endif // HAVE_X86_SIMD
+
+typedef int (*StuffKernel)(unsigned char *, const unsigned char *, int, unsigned char *);
+
+static StuffKernel stuffKernel = NULL;
+static const char *stuffKernelLabel = "scalar";
+
+/**
+ * @brief Picks the kernel for this CPU on first use.
+ */
+static void selectStuffKernel()
+{
+    stuffKernel = stuffBytesScalar;
+    stuffKernelLabel = "scalar";
+
+#ifdef HAVE_X86_SIMD
+    stuffKernel = stuffBytesSSE2;
+    stuffKernelLabel = "sse2";
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        stuffKernel = stuffBytesAVX2;
+        stuffKernelLabel = "avx2";
+    }
+#endif
+}
+
+/**
+ * @brief Stuffs a buffer with the best available kernel and folds its XOR into *bcc.
+ *
+ * @param dst Output buffer (at least 2 * size bytes).
+ * @param src Input bytes.
+ * @param size Number of input bytes.
+ * @param bcc XOR accumulator, or NULL.
+ * @return The number of bytes written to dst.
+ */
+int stuffBytes(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc)
+{
+    if (stuffKernel == NULL) selectStuffKernel();
+    return stuffKernel(dst, src, size, bcc);
+}
+
+const char *stuffKernelName()
+{
+    if (stuffKernel == NULL) selectStuffKernel();
+    return stuffKernelLabel;
+}
@@ -0,0 +1,26 @@
+// Byte stuffing encoder for I-frames.
+// Escapes FLAG (0x7E) and ESC (0x7D) as ESC, byte ^ 0x20 and computes the XOR
+// of the input (BCC2) in the same pass.
+
+#ifndef _BYTE_STUFFING_H_
+#define _BYTE_STUFFING_H_
+
+#define STUFF_FLAG 0x7E
+#define STUFF_ESC  0x7D
+
+// Stuff size bytes from src into dst (dst must hold 2 * size bytes).
+// If bcc is not NULL, the XOR of the input bytes is folded into *bcc.
+// Uses the fastest kernel the CPU supports (AVX2, SSE2 or scalar).
+// Returns the number of bytes written to dst.
+int stuffBytes(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc);
+
+// Name of the kernel selected by stuffBytes ("avx2", "sse2" or "scalar").
+const char *stuffKernelName();
+
+// Individual kernels, exposed for benchmarking (tools/bench_framing.c).
+// The SIMD ones are only available when the CPU supports them.
+int stuffBytesScalar(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc);
+int stuffBytesSSE2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc);
+int stuffBytesAVX2(unsigned char *dst, const unsigned char *src, int size, unsigned char *bcc);
+
+#endif // _BYTE_STUFFING_H_
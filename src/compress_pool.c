@@ -0,0 +1,175 @@
+// Compression worker pool implementation
+
+#include "compress_pool.h"
+#include "compressor.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Jobs live in a ring: jobs[head] is the oldest (the next one to be sent),
+ * count jobs follow it, and nextJob is the first one no worker has taken yet.
+ * One mutex protects the ring; workers wait on workReady, the transmitter on jobDone.
+ */
+static CompressJob *jobs = NULL;
+static int capacity = 0;
+static int head = 0;
+static int count = 0;
+static int nextJob = 0;
+static int pending = 0;         // Submitted jobs not yet taken by a worker
+
+static pthread_t threads[MAX_COMPRESS_THREADS];
+static int nThreads = 0;
+static int minSaving = 0;
+static bool stopping = false;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Compresses one job; falls back to raw when it is not worth it.
+ */
+static void compressJob(CompressJob *job)
+{
+    job->compressed = false;
+    if (!looksCompressible(job->input, job->inputSize)) return;
+
+    int size = compressBlock(job->input, job->inputSize, job->output, job->inputSize - minSaving - 1);
+    if (size < 0) return;
+
+    job->outputSize = size;
+    job->compressed = true;
+}
+
+/**
+ * @brief Worker: takes jobs in submission order until the pool is stopped.
+ */
+static void *worker(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (pending == 0 && !stopping) pthread_cond_wait(&workReady, &lock);
+        if (stopping) break;
+
+        CompressJob *job = &jobs[nextJob];
+        nextJob = (nextJob + 1) % capacity;
+        pending--;
+
+        pthread_mutex_unlock(&lock);
+        compressJob(job);
+        pthread_mutex_lock(&lock);
+
+        job->done = true;
+        pthread_cond_broadcast(&jobDone);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/**
+ * @brief Allocates the job ring and starts the workers.
+ *
+ * @param threadCount Number of workers, 0 to send every block raw.
+ * @param maxBlockSize Largest block that will be submitted.
+ * @param saving Bytes a compressed block must save to be used (its larger header).
+ * @return 0 on success, -1 on error.
+ */
+int initCompressPool(int threadCount, int maxBlockSize, int saving)
+{
+    if (threadCount > MAX_COMPRESS_THREADS) threadCount = MAX_COMPRESS_THREADS;
+    if (threadCount < 0) threadCount = 0;
+
+    capacity = (threadCount > 0) ? threadCount * BLOCKS_PER_THREAD : 1;
+    jobs = calloc(capacity, sizeof(CompressJob));
+    if (jobs == NULL) return -1;
+
+    for (int i = 0; i < capacity && threadCount > 0; i++) {
+        jobs[i].output = malloc(maxBlockSize);
+        if (jobs[i].output == NULL) {
+            freeCompressPool();
+            return -1;
+        }
+    }
+
+    head = count = nextJob = pending = 0;
+    minSaving = saving;
+    stopping = false;
+
+    for (nThreads = 0; nThreads < threadCount; nThreads++) {
+        if (pthread_create(&threads[nThreads], NULL, worker, NULL) != 0) {
+            perror("pthread_create");
+            freeCompressPool();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void freeCompressPool()
+{
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&workReady);
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < nThreads; i++) pthread_join(threads[i], NULL);
+    nThreads = 0;
+
+    for (int i = 0; i < capacity && jobs != NULL; i++) free(jobs[i].output);
+    free(jobs);
+    jobs = NULL;
+    capacity = 0;
+}
+
+bool compressPoolHasRoom()
+{
+    return count < capacity;
+}
+
+/**
+ * @brief Queues a block. Without workers it is marked raw and done at once.
+ */
+int submitBlock(const unsigned char *input, int size)
+{
+    if (count == capacity) return -1;
+
+    pthread_mutex_lock(&lock);
+    CompressJob *job = &jobs[(head + count) % capacity];
+    job->input = input;
+    job->inputSize = size;
+    job->outputSize = 0;
+    job->compressed = false;
+    job->done = (nThreads == 0);
+    count++;
+
+    if (nThreads > 0) {
+        pending++;
+        pthread_cond_signal(&workReady);
+    }
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+const CompressJob *waitBlock()
+{
+    if (count == 0) return NULL;
+
+    CompressJob *job = &jobs[head];
+    pthread_mutex_lock(&lock);
+    while (!job->done) pthread_cond_wait(&jobDone, &lock);
+    pthread_mutex_unlock(&lock);
+    return job;
+}
+
+void releaseBlock()
+{
+    if (count == 0) return;
+
+    pthread_mutex_lock(&lock);
+    jobs[head].done = false;
+    head = (head + 1) % capacity;
+    count--;
+    pthread_mutex_unlock(&lock);
+}
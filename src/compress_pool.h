@@ -0,0 +1,48 @@
+// Worker pool that compresses data blocks ahead of the transmitter.
+// Blocks are submitted in file order and collected in the same order; the
+// workers compress the ones behind the block being sent. A block that looks
+// random (see looksCompressible) or does not shrink is returned raw.
+// Without workers (compression off) blocks are returned raw straight away.
+
+#ifndef _COMPRESS_POOL_H_
+#define _COMPRESS_POOL_H_
+
+#include <stdbool.h>
+
+#define MAX_COMPRESS_THREADS 8
+
+// Blocks in flight per worker
+#define BLOCKS_PER_THREAD 2
+
+typedef struct
+{
+    const unsigned char *input;  // Slice of the file (not copied)
+    int inputSize;
+    unsigned char *output;       // Compressed bytes, valid if compressed is TRUE
+    int outputSize;
+    bool compressed;
+    bool done;
+} CompressJob;
+
+// Start nThreads workers (0 for none) for blocks of up to maxBlockSize bytes.
+// A compressed block is only kept if it saves more than minSaving bytes.
+// Returns 0 on success or -1 on error.
+int initCompressPool(int nThreads, int maxBlockSize, int minSaving);
+
+// Stop the workers and release the buffers.
+void freeCompressPool();
+
+// TRUE if another block can be submitted.
+bool compressPoolHasRoom();
+
+// Queue size bytes of input (which must stay valid until the block is released).
+// Returns 0 on success or -1 if the queue is full.
+int submitBlock(const unsigned char *input, int size);
+
+// Wait for the oldest block. Returns NULL if no block was submitted.
+const CompressJob *waitBlock();
+
+// Drop the oldest block, making room for another one.
+void releaseBlock();
+
+#endif // _COMPRESS_POOL_H_
@@ -0,0 +1,206 @@
+// Block compressor implementation
+
+#include "compressor.h"
+#include <stdint.h>
+#include <string.h>
+
+// Match finder: last position seen for each hash of 4 bytes
+#define HASH_BITS 12
+#define MAX_OFFSET 65535
+
+// After this many positions without a match the search starts skipping bytes
+#define SKIP_TRIGGER 6
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static int hash4(const unsigned char *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * @brief Number of bytes needed to extend a length field that overflowed its nibble.
+ */
+static int extraLengthBytes(int length)
+{
+    return (length >= 15) ? (length - 15) / 255 + 1 : 0;
+}
+
+/**
+ * @brief Writes the bytes that follow a nibble of 15: 255 while more remains, then the rest.
+ */
+static int writeExtraLength(unsigned char *dst, int length)
+{
+    int out = 0;
+    for (length -= 15; length >= 255; length -= 255) dst[out++] = 255;
+    dst[out++] = length;
+    return out;
+}
+
+/**
+ * @brief Appends one sequence: token, literals and, if matchLength > 0, the match.
+ *
+ * @return The new output size, or -1 if the sequence does not fit in dstCapacity.
+ */
+static int writeSequence(unsigned char *dst, int out, int dstCapacity,
+                         const unsigned char *literals, int literalLength,
+                         int offset, int matchLength)
+{
+    int matchCode = (matchLength > 0) ? matchLength - MIN_MATCH : 0;
+    int needed = 1 + extraLengthBytes(literalLength) + literalLength;
+    if (matchLength > 0) needed += 2 + extraLengthBytes(matchCode);
+    if (out + needed > dstCapacity) return -1;
+
+    unsigned char *token = &dst[out++];
+    *token = ((literalLength < 15) ? literalLength : 15) << 4;
+    if (literalLength >= 15) out += writeExtraLength(dst + out, literalLength);
+    memcpy(dst + out, literals, literalLength);
+    out += literalLength;
+
+    if (matchLength > 0) {
+        *token |= (matchCode < 15) ? matchCode : 15;
+        dst[out++] = offset & 0xFF;
+        dst[out++] = offset >> 8;
+        if (matchCode >= 15) out += writeExtraLength(dst + out, matchCode);
+    }
+    return out;
+}
+
+/**
+ * @brief Greedy LZ77 compression of one block.
+ *
+ * A hash of the next 4 bytes gives the last position where they were seen; a
+ * confirmed match is extended forwards and backwards. In long stretches without
+ * matches the search skips more and more bytes, so incompressible parts cost little.
+ *
+ * @return The compressed size, or -1 if it does not fit in dstCapacity bytes.
+ */
+int compressBlock(const unsigned char *src, int size, unsigned char *dst, int dstCapacity)
+{
+    int table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    int out = 0;
+    int anchor = 0;     // First byte not yet written
+    int misses = 0;
+    int i = 0;
+
+    while (i + MIN_MATCH <= size) {
+        int h = hash4(src + i);
+        int candidate = table[h];
+        table[h] = i;
+
+        if (candidate < 0 || i - candidate > MAX_OFFSET || read32(src + candidate) != read32(src + i)) {
+            misses++;
+            i += 1 + (misses >> SKIP_TRIGGER);
+            continue;
+        }
+        misses = 0;
+
+        int length = MIN_MATCH;
+        while (i + length < size && src[candidate + length] == src[i + length]) length++;
+        while (i > anchor && candidate > 0 && src[i - 1] == src[candidate - 1]) {
+            i--;
+            candidate--;
+            length++;
+        }
+
+        out = writeSequence(dst, out, dstCapacity, src + anchor, i - anchor, i - candidate, length);
+        if (out < 0) return -1;
+
+        i += length;
+        anchor = i;
+    }
+
+    return writeSequence(dst, out, dstCapacity, src + anchor, size - anchor, 0, 0);
+}
+
+/**
+ * @brief Reads a length that overflowed its nibble.
+ *
+ * @return The full length, or -1 if the block ends first.
+ */
+static int readExtraLength(const unsigned char *src, int size, int *pos, int length)
+{
+    unsigned char byte;
+    do {
+        if (*pos >= size) return -1;
+        byte = src[(*pos)++];
+        length += byte;
+    } while (byte == 255);
+    return length;
+}
+
+/**
+ * @brief Decompresses one block, checking every length and offset against the buffers.
+ */
+int decompressBlock(const unsigned char *src, int size, unsigned char *dst, int dstCapacity)
+{
+    int in = 0;
+    int out = 0;
+
+    while (in < size) {
+        unsigned char token = src[in++];
+
+        int literalLength = token >> 4;
+        if (literalLength == 15) literalLength = readExtraLength(src, size, &in, literalLength);
+        if (literalLength < 0 || literalLength > size - in || literalLength > dstCapacity - out) return -1;
+
+        memcpy(dst + out, src + in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        // The last sequence has no match
+        if (in == size) break;
+
+        if (size - in < 2) return -1;
+        int offset = src[in] | (src[in + 1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out) return -1;
+
+        int length = token & 0x0F;
+        if (length == 15) length = readExtraLength(src, size, &in, length);
+        if (length < 0) return -1;
+        length += MIN_MATCH;
+        if (length > dstCapacity - out) return -1;
+
+        // The match may overlap the bytes it produces (a run), so copy forwards
+        const unsigned char *match = dst + out - offset;
+        if (offset >= length) {
+            memcpy(dst + out, match, length);
+        } else {
+            for (int k = 0; k < length; k++) dst[out + k] = match[k];
+        }
+        out += length;
+    }
+    return out;
+}
+
+/**
+ * @brief Estimates how spread out the byte values of a block are.
+ *
+ * Up to ENTROPY_SAMPLE_SIZE bytes taken evenly across the block are counted.
+ * The probability that two sampled bytes are equal, sum c(c-1) / n(n-1), is
+ * 1/256 for random data; a block is worth compressing when it is higher than
+ * 1/MAX_EFFECTIVE_ALPHABET.
+ */
+bool looksCompressible(const unsigned char *src, int size)
+{
+    if (size < 2 * MIN_MATCH) return false;
+
+    int counts[256] = {0};
+    int n = (size < ENTROPY_SAMPLE_SIZE) ? size : ENTROPY_SAMPLE_SIZE;
+    for (int i = 0; i < n; i++) {
+        counts[src[(long long)i * size / n]]++;
+    }
+
+    long long pairs = 0;
+    for (int b = 0; b < 256; b++) pairs += (long long)counts[b] * (counts[b] - 1);
+
+    return pairs * MAX_EFFECTIVE_ALPHABET > (long long)n * (n - 1);
+}
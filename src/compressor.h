@@ -0,0 +1,35 @@
+// Block compressor for data packets.
+// A small LZ77 coder in the LZ4 style: each sequence is a token (literal count
+// in the high nibble, match length - 4 in the low nibble, 15 meaning "more
+// bytes follow"), the literals, and a 2-byte little-endian match offset. The
+// last sequence has literals only. Blocks are independent.
+
+#ifndef _COMPRESSOR_H_
+#define _COMPRESSOR_H_
+
+#include <stdbool.h>
+
+// Shortest match that is encoded
+#define MIN_MATCH 4
+
+// A block whose bytes are as spread out as this many equally likely values
+// (or more) is sent raw; random data scores 256, text about 20
+#define MAX_EFFECTIVE_ALPHABET 180
+
+// Bytes of a block looked at by looksCompressible
+#define ENTROPY_SAMPLE_SIZE 4096
+
+// Compress size bytes of src into dst.
+// Returns the compressed size, or -1 if it would not fit in dstCapacity bytes.
+int compressBlock(const unsigned char *src, int size, unsigned char *dst, int dstCapacity);
+
+// Decompress a block produced by compressBlock.
+// Returns the decompressed size, or -1 if the block is malformed or
+// does not fit in dstCapacity bytes.
+int decompressBlock(const unsigned char *src, int size, unsigned char *dst, int dstCapacity);
+
+// Quick test on a sample of the block: FALSE for data that looks random
+// (e.g. an already compressed GIF), which is not worth compressing.
+bool looksCompressible(const unsigned char *src, int size);
+
+#endif // _COMPRESSOR_H_
@@ -0,0 +1,366 @@
+// Delta transfer implementation
+
+#include "delta_sync.h"
+#include "file_digest.h"
+#include "packet_types.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct
+{
+    uint32_t weak;      // Rolling checksum
+    uint64_t strong;    // XXH64
+} Signature;
+
+// A run of consecutive blocks of the receiver's copy found at a file offset
+typedef struct
+{
+    long long offset;
+    uint32_t first;
+    uint32_t count;
+} Copy;
+
+static Signature *signatures = NULL;
+static uint32_t blockSize = 0;
+static uint32_t blockCount = 0;
+static uint32_t signaturesDone = 0;    // Built (receiver) or received (transmitter)
+
+// Receiver: the old copy
+static unsigned char *basis = NULL;
+static long long basisSize = 0;
+
+// Transmitter: signatures by rolling checksum, then the blocks found in the file
+static int *bucketHead = NULL;
+static int *bucketNext = NULL;
+static uint32_t bucketMask = 0;
+static Copy *copies = NULL;
+static int copyCount = 0;
+static int copyCapacity = 0;
+static int copiesSent = 0;
+static int literalCursor = 0;   // Gap before copies[literalCursor] is the next one
+static long long planSize = 0;
+
+/**
+ * @brief Rolling checksum of a block (as in rsync): the sum of its bytes in the
+ * low 16 bits and the sum of the running sums in the high ones.
+ */
+static uint32_t rollingChecksum(const unsigned char *data, uint32_t size)
+{
+    uint32_t a = 0, b = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        a += data[i];
+        b += a;
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+/**
+ * @brief Slides the checksum of a block one byte: out leaves it, in enters it.
+ */
+static uint32_t rollChecksum(uint32_t weak, unsigned char out, unsigned char in, uint32_t size)
+{
+    uint32_t a = (weak & 0xffff) - out + in;
+    uint32_t b = (weak >> 16) - size * out + a;
+    return (a & 0xffff) | (b << 16);
+}
+
+static uint64_t strongHash(const unsigned char *data, uint32_t size)
+{
+    DigestState state;
+    initDigest(&state);
+    updateDigest(&state, data, size);
+    return finishDigest(&state);
+}
+
+static uint32_t bucketOf(uint32_t weak)
+{
+    uint32_t hash = weak * 0x9E3779B1u;
+    return (hash ^ (hash >> 15)) & bucketMask;
+}
+
+// =================================================================
+// Receiver
+// =================================================================
+
+/**
+ * @brief Picks the block size for an old copy of size bytes.
+ */
+static uint32_t chooseBlockSize(long long size)
+{
+    // Integer square root (Newton)
+    long long root = size;
+    while (root > size / root) root = (root + size / root) / 2;
+    if (root < DELTA_MIN_BLOCK) root = DELTA_MIN_BLOCK;
+    if (size / root > DELTA_MAX_BLOCKS) root = size / DELTA_MAX_BLOCKS + 1;
+    return root;
+}
+
+int openBasis(const char *filename)
+{
+    closeBasis();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < DELTA_MIN_BLOCK) {
+        close(fd);
+        return 0;
+    }
+
+    basis = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (basis == MAP_FAILED) {
+        perror("mmap");
+        basis = NULL;
+        return -1;
+    }
+    basisSize = st.st_size;
+    madvise(basis, basisSize, MADV_SEQUENTIAL);
+
+    // Only whole blocks get a signature; the tail of the copy is not reused
+    blockSize = chooseBlockSize(basisSize);
+    blockCount = basisSize / blockSize;
+    signatures = malloc(blockCount * sizeof(Signature));
+    if (signatures == NULL) {
+        closeBasis();
+        return -1;
+    }
+    for (uint32_t i = 0; i < blockCount; i++) {
+        const unsigned char *block = basis + (long long)i * blockSize;
+        signatures[i].weak = rollingChecksum(block, blockSize);
+        signatures[i].strong = strongHash(block, blockSize);
+    }
+    signaturesDone = 0;
+    return blockCount;
+}
+
+uint32_t basisBlockSize()
+{
+    return blockSize;
+}
+
+int buildSignatureReply(unsigned char *reply, int maxSize)
+{
+    if (signaturesDone == blockCount) return 0;
+
+    int index = 0;
+    reply[index++] = C_SIGNATURES;
+    memcpy(&reply[index], &signaturesDone, 4);
+    index += 4;
+    while (signaturesDone < blockCount && index + SIGNATURE_SIZE <= maxSize) {
+        memcpy(&reply[index], &signatures[signaturesDone].weak, 4);
+        memcpy(&reply[index + 4], &signatures[signaturesDone].strong, 8);
+        index += SIGNATURE_SIZE;
+        signaturesDone++;
+    }
+    return index;
+}
+
+const unsigned char *basisBlocks(uint32_t first, uint32_t count, long long *size)
+{
+    if (basis == NULL || count == 0 || first >= blockCount || count > blockCount - first) return NULL;
+    *size = (long long)count * blockSize;
+    return basis + (long long)first * blockSize;
+}
+
+void closeBasis()
+{
+    if (basis != NULL) munmap(basis, basisSize);
+    basis = NULL;
+    basisSize = 0;
+    free(signatures);
+    signatures = NULL;
+    blockCount = signaturesDone = 0;
+}
+
+// =================================================================
+// Transmitter
+// =================================================================
+
+int expectSignatures(uint32_t size, uint32_t count)
+{
+    freeDelta();
+    if (size == 0 || count == 0 || count > DELTA_MAX_BLOCKS) return -1;
+
+    blockSize = size;
+    blockCount = count;
+    signatures = malloc(count * sizeof(Signature));
+    return (signatures == NULL) ? -1 : 0;
+}
+
+int addSignatures(const unsigned char *reply, int size)
+{
+    // Replies have no sequence number: the START reply comes again if its
+    // acknowledgement was lost
+    if (size > 0 && reply[0] == C_START) return 0;
+    if (size < SIGNATURE_HEADER_SIZE || reply[0] != C_SIGNATURES) return -1;
+
+    uint32_t first;
+    memcpy(&first, &reply[1], 4);
+    int n = (size - SIGNATURE_HEADER_SIZE) / SIGNATURE_SIZE;
+
+    // A reply whose acknowledgement was lost comes again
+    if (first < signaturesDone) return 0;
+    if (first > signaturesDone || n == 0 || n > blockCount - first) return -1;
+
+    const unsigned char *entry = reply + SIGNATURE_HEADER_SIZE;
+    for (int i = 0; i < n; i++, entry += SIGNATURE_SIZE) {
+        memcpy(&signatures[first + i].weak, entry, 4);
+        memcpy(&signatures[first + i].strong, entry + 4, 8);
+    }
+    signaturesDone += n;
+    return (signaturesDone == blockCount) ? 1 : 0;
+}
+
+/**
+ * @brief Records block index found at offset, extending the last run if it continues it.
+ */
+static int addCopy(long long offset, uint32_t index)
+{
+    if (copyCount > 0) {
+        Copy *last = &copies[copyCount - 1];
+        if (last->offset + (long long)last->count * blockSize == offset && last->first + last->count == index) {
+            last->count++;
+            return 0;
+        }
+    }
+    if (copyCount == copyCapacity) {
+        int capacity = (copyCapacity > 0) ? copyCapacity * 2 : 64;
+        Copy *grown = realloc(copies, capacity * sizeof(Copy));
+        if (grown == NULL) return -1;
+        copies = grown;
+        copyCapacity = capacity;
+    }
+    copies[copyCount].offset = offset;
+    copies[copyCount].first = index;
+    copies[copyCount].count = 1;
+    copyCount++;
+    return 0;
+}
+
+/**
+ * @brief Looks for a block with this rolling checksum and the window's strong hash.
+ *
+ * The block after the last one found is tried first, so an unchanged stretch of
+ * the file becomes one run even if some of its blocks appear elsewhere too.
+ *
+ * @return The block index, or -1 if none matches.
+ */
+static int findBlock(const unsigned char *window, uint32_t weak, long long offset)
+{
+    uint64_t strong = 0;
+    bool hashed = false;
+
+    if (copyCount > 0) {
+        const Copy *last = &copies[copyCount - 1];
+        uint32_t next = last->first + last->count;
+        if (last->offset + (long long)last->count * blockSize == offset && next < blockCount &&
+            signatures[next].weak == weak) {
+            strong = strongHash(window, blockSize);
+            hashed = true;
+            if (signatures[next].strong == strong) return next;
+        }
+    }
+
+    for (int i = bucketHead[bucketOf(weak)]; i >= 0; i = bucketNext[i]) {
+        if (signatures[i].weak != weak) continue;
+        if (!hashed) {
+            strong = strongHash(window, blockSize);
+            hashed = true;
+        }
+        if (signatures[i].strong == strong) return i;
+    }
+    return -1;
+}
+
+long long planDelta(const unsigned char *data, long long size)
+{
+    planSize = size;
+    copyCount = copiesSent = literalCursor = 0;
+    if (signaturesDone != blockCount || size < blockSize) return 0;
+
+    // Chained hash table of the signatures, at least twice as many buckets as blocks
+    uint32_t buckets = 1024;
+    while (buckets < 2 * blockCount) buckets *= 2;
+    bucketMask = buckets - 1;
+    bucketHead = malloc(buckets * sizeof(int));
+    bucketNext = malloc(blockCount * sizeof(int));
+    if (bucketHead == NULL || bucketNext == NULL) return 0;
+    memset(bucketHead, 0xff, buckets * sizeof(int));
+    for (int i = blockCount - 1; i >= 0; i--) {
+        uint32_t bucket = bucketOf(signatures[i].weak);
+        bucketNext[i] = bucketHead[bucket];
+        bucketHead[bucket] = i;
+    }
+
+    long long covered = 0;
+    long long offset = 0;
+    uint32_t weak = rollingChecksum(data, blockSize);
+    while (offset + blockSize <= size) {
+        int index = findBlock(data + offset, weak, offset);
+        if (index >= 0) {
+            if (addCopy(offset, index) < 0) break;
+            covered += blockSize;
+            offset += blockSize;
+            if (offset + blockSize <= size) weak = rollingChecksum(data + offset, blockSize);
+        } else {
+            if (offset + blockSize < size) weak = rollChecksum(weak, data[offset], data[offset + blockSize], blockSize);
+            offset++;
+        }
+    }
+    return covered;
+}
+
+int buildCopyPacket(unsigned char *packet, int maxSize, long long *covered)
+{
+    int index = 0;
+    *covered = 0;
+    if (copiesSent == copyCount) return 0;
+
+    packet[index++] = C_COPY;
+    while (copiesSent < copyCount && index + COPY_ENTRY_SIZE <= maxSize) {
+        const Copy *copy = &copies[copiesSent++];
+        memcpy(&packet[index], &copy->offset, 8);
+        memcpy(&packet[index + 8], &copy->first, 4);
+        memcpy(&packet[index + 12], &copy->count, 4);
+        index += COPY_ENTRY_SIZE;
+        *covered += (long long)copy->count * blockSize;
+    }
+    return index;
+}
+
+bool nextLiteralRange(long long *start, long long *end)
+{
+    while (literalCursor <= copyCount) {
+        long long from = (literalCursor == 0) ? 0
+                       : copies[literalCursor - 1].offset + (long long)copies[literalCursor - 1].count * blockSize;
+        long long to = (literalCursor < copyCount) ? copies[literalCursor].offset : planSize;
+        literalCursor++;
+        if (from < to) {
+            *start = from;
+            *end = to;
+            return true;
+        }
+    }
+    return false;
+}
+
+void freeDelta()
+{
+    free(signatures);
+    free(bucketHead);
+    free(bucketNext);
+    free(copies);
+    signatures = NULL;
+    bucketHead = bucketNext = NULL;
+    copies = NULL;
+    blockSize = blockCount = signaturesDone = 0;
+    copyCount = copyCapacity = copiesSent = literalCursor = 0;
+    planSize = 0;
+}
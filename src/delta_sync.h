@@ -0,0 +1,73 @@
+// Delta transfers: only the parts of a file the receiver does not have yet.
+// When the receiver already has an older copy of the file, it cuts that copy
+// into blocks and sends the transmitter the signature of each one (a rolling
+// checksum and an XXH64) in reply frames. The transmitter looks for the blocks
+// at every byte offset of its file, sliding the rolling checksum one byte at a
+// time and checking the strong hash only when it matches. Blocks found are sent
+// as C_COPY references, which the receiver fills in from its old copy; the rest
+// of the file travels in C_DATA_AT packets as usual.
+
+#ifndef _DELTA_SYNC_H_
+#define _DELTA_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Blocks are about the square root of the old copy's size, at least this large
+#define DELTA_MIN_BLOCK 512
+
+// Largest number of blocks in the old copy (larger copies get larger blocks)
+#define DELTA_MAX_BLOCKS (1 << 20)
+
+// Signature reply: C_SIGNATURES | Index of its first block (4 bytes) | Signatures,
+// each the rolling checksum (4 bytes) and the XXH64 (8 bytes) of a block
+#define SIGNATURE_HEADER_SIZE 5
+#define SIGNATURE_SIZE 12
+
+// Copy packet: C_COPY | Entries of File offset (8 bytes) | First block (4 bytes) | Blocks (4 bytes)
+#define COPY_ENTRY_SIZE 16
+
+// ---- Receiver ----
+
+// Map the old copy in filename and compute the signatures of its whole blocks.
+// Returns the number of blocks (0 if there is no copy worth using) or -1 on error.
+int openBasis(const char *filename);
+
+// Size of the blocks of the old copy.
+uint32_t basisBlockSize();
+
+// Build the next signature reply of at most maxSize bytes.
+// Returns its size, or 0 once every signature was built.
+int buildSignatureReply(unsigned char *reply, int maxSize);
+
+// The bytes of count blocks of the old copy from block first; sets *size.
+// Returns NULL if they are not all in the copy.
+const unsigned char *basisBlocks(uint32_t first, uint32_t count, long long *size);
+
+// Unmap the old copy and release the signatures.
+void closeBasis();
+
+// ---- Transmitter ----
+
+// Expect count signatures of blocks of blockSize bytes. Returns 0 on success or -1 on error.
+int expectSignatures(uint32_t blockSize, uint32_t count);
+
+// Add the signatures of a reply. Returns 1 once all arrived, 0 if more are expected
+// (a repeated reply, or a repeated START reply, is ignored), or -1 on an invalid reply.
+int addSignatures(const unsigned char *reply, int size);
+
+// Find the blocks of the receiver's copy in the file. Returns the bytes they cover.
+long long planDelta(const unsigned char *data, long long size);
+
+// Build the next copy packet of at most maxSize bytes; *covered is set to the file bytes
+// it stands for. Returns its size, or 0 once every block found was referenced.
+int buildCopyPacket(unsigned char *packet, int maxSize, long long *covered);
+
+// The next stretch of the file that no block covers, [*start, *end).
+// Returns FALSE when there is none left.
+bool nextLiteralRange(long long *start, long long *end);
+
+// Release the signatures and the plan.
+void freeDelta();
+
+#endif // _DELTA_SYNC_H_
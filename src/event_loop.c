@@ -0,0 +1,183 @@
+// Event loop implementation
+
+#include "event_loop.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// epoll_event.data.u32 tells the descriptors apart: timers have this bit set,
+// the rest of the value is the index in fds[] or timers[]
+#define TIMER_TAG 0x80000000u
+
+/**
+ * @brief Creates the epoll instance of a loop.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int initEventLoop(EventLoop *loop)
+{
+    memset(loop, 0, sizeof(EventLoop));
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+    return 0;
+}
+
+void freeEventLoop(EventLoop *loop)
+{
+    for (int i = 0; i < loop->nTimers; i++) {
+        close(loop->timers[i].fd);
+    }
+    if (loop->epollFd >= 0) close(loop->epollFd);
+    loop->epollFd = -1;
+    loop->nTimers = 0;
+    loop->nFds = 0;
+}
+
+/**
+ * @brief Adds a descriptor to the set waited for by waitEvents (level-triggered).
+ *
+ * @return 0 on success, -1 on error.
+ */
+int watchFd(EventLoop *loop, int fd)
+{
+    if (loop->nFds == MAX_LOOP_FDS) return -1;
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = loop->nFds};
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    loop->fds[loop->nFds++] = fd;
+    return 0;
+}
+
+/**
+ * @brief Creates a disarmed timer backed by a timerfd.
+ *
+ * @return The timer id, or -1 on error.
+ */
+int createTimer(EventLoop *loop)
+{
+    if (loop->nTimers == MAX_LOOP_TIMERS) return -1;
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    int id = loop->nTimers;
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = TIMER_TAG | id};
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, tfd, &ev) < 0) {
+        perror("epoll_ctl");
+        close(tfd);
+        return -1;
+    }
+
+    loop->timers[id] = (LoopTimer){.fd = tfd, .armed = false, .deadline = 0, .expirations = 0};
+    loop->nTimers++;
+    return id;
+}
+
+/**
+ * @brief Sets the timerfd of a timer (a zero value disarms it).
+ */
+static void setTimerFd(int tfd, int ms)
+{
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+    timerfd_settime(tfd, 0, &spec, NULL);
+}
+
+void armTimer(EventLoop *loop, int timer, int ms)
+{
+    LoopTimer *t = &loop->timers[timer];
+    if (ms < 1) ms = 1;
+    t->deadline = currentTimeMs() + ms;
+    t->armed = true;
+    setTimerFd(t->fd, ms);
+}
+
+void disarmTimer(EventLoop *loop, int timer)
+{
+    LoopTimer *t = &loop->timers[timer];
+    t->armed = false;
+    setTimerFd(t->fd, 0);
+}
+
+/**
+ * @brief Checks a timer against its deadline.
+ *
+ * The deadline is compared with the clock rather than waiting for the timerfd
+ * to be reported, so an expiration is seen even when the caller never had to
+ * wait (e.g. the bytes it needed were already buffered).
+ */
+bool timerPending(EventLoop *loop, int timer)
+{
+    LoopTimer *t = &loop->timers[timer];
+    if (!t->armed) return false;
+    if (currentTimeMs() < t->deadline) return true;
+
+    t->armed = false;
+    t->expirations++;
+    return false;
+}
+
+/**
+ * @brief Waits for a watched descriptor or a timer.
+ *
+ * Expired timerfds are drained here; their state is read with timerPending.
+ *
+ * @param timeoutMs -1 to wait without limit, 0 to return immediately.
+ * @return The number of events, 0 if none (or interrupted by a signal), -1 on error.
+ */
+int waitEvents(EventLoop *loop, int timeoutMs)
+{
+    struct epoll_event events[MAX_LOOP_FDS + MAX_LOOP_TIMERS];
+
+    for (int i = 0; i < loop->nFds; i++) loop->readable[i] = false;
+
+    int n = epoll_wait(loop->epollFd, events, MAX_LOOP_FDS + MAX_LOOP_TIMERS, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t tag = events[i].data.u32;
+        if (tag & TIMER_TAG) {
+            uint64_t count;
+            if (read(loop->timers[tag & ~TIMER_TAG].fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                perror("read timerfd");
+            }
+        } else {
+            loop->readable[tag] = true;
+        }
+    }
+    return n;
+}
+
+bool fdReadable(EventLoop *loop, int fd)
+{
+    for (int i = 0; i < loop->nFds; i++) {
+        if (loop->fds[i] == fd) return loop->readable[i];
+    }
+    return false;
+}
+
+double currentTimeMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
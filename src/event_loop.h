@@ -0,0 +1,65 @@
+// Event loop for the link layer, built on epoll and timerfd.
+// Waits for file descriptors to become readable and for timers to expire
+// without signals, so any number of timers and descriptors can be in use at
+// once (one loop per link).
+
+#ifndef _EVENT_LOOP_H_
+#define _EVENT_LOOP_H_
+
+#include <stdbool.h>
+
+#define MAX_LOOP_FDS    4
+#define MAX_LOOP_TIMERS 4
+
+typedef struct
+{
+    int fd;             // timerfd
+    bool armed;         // Armed and not yet expired
+    double deadline;    // currentTimeMs() at which it expires
+    int expirations;    // Number of times it expired since it was created
+} LoopTimer;
+
+typedef struct
+{
+    int epollFd;
+    int fds[MAX_LOOP_FDS];
+    bool readable[MAX_LOOP_FDS];   // Set by the last waitEvents call
+    int nFds;
+    LoopTimer timers[MAX_LOOP_TIMERS];
+    int nTimers;
+} EventLoop;
+
+// Create the epoll instance. Returns 0 on success or -1 on error.
+int initEventLoop(EventLoop *loop);
+
+// Close the epoll instance and every timer.
+void freeEventLoop(EventLoop *loop);
+
+// Wait for fd to become readable. Returns 0 on success or -1 on error.
+int watchFd(EventLoop *loop, int fd);
+
+// Create a timer. Returns its id or -1 on error.
+int createTimer(EventLoop *loop);
+
+// Arm a timer to expire in ms milliseconds, replacing any previous deadline.
+void armTimer(EventLoop *loop, int timer, int ms);
+
+// Stop a timer.
+void disarmTimer(EventLoop *loop, int timer);
+
+// TRUE while the timer is armed and its deadline has not passed.
+// A timer found expired here is disarmed and counted as an expiration.
+bool timerPending(EventLoop *loop, int timer);
+
+// Wait until a watched fd is readable or a timer expires.
+// timeoutMs: -1 waits without limit, 0 only checks.
+// Returns the number of events (0 on timeout), or -1 on error.
+int waitEvents(EventLoop *loop, int timeoutMs);
+
+// Whether fd was readable in the last waitEvents call.
+bool fdReadable(EventLoop *loop, int fd);
+
+// Monotonic clock in milliseconds (the clock of every deadline).
+double currentTimeMs();
+
+#endif // _EVENT_LOOP_H_
@@ -0,0 +1,269 @@
+// Frame check sequence implementation
+
+#include "fcs.h"
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_CRC32 1
+#endif
+
+#define CRC16_POLY  0x1021
+#define CRC16_INIT  0xFFFF
+#define CRC32C_POLY 0x82F63B78u  // Reflected Castagnoli polynomial
+#define CRC32C_INIT 0xFFFFFFFFu
+
+// Slice-by-8 tables: table[k][b] is the CRC contribution of byte b followed by k zero bytes
+static uint16_t crc16Table[8][256];
+static uint32_t crc32cTable[8][256];
+static bool tablesReady = false;
+
+/**
+ * @brief Builds the slice-by-8 tables for both CRCs (done once, on first use).
+ */
+static void initTables()
+{
+    for (int b = 0; b < 256; b++) {
+        uint16_t crc16 = b << 8;
+        uint32_t crc32 = b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc16 = (crc16 & 0x8000) ? (crc16 << 1) ^ CRC16_POLY : (crc16 << 1);
+            crc32 = (crc32 & 1) ? (crc32 >> 1) ^ CRC32C_POLY : (crc32 >> 1);
+        }
+        crc16Table[0][b] = crc16;
+        crc32cTable[0][b] = crc32;
+    }
+
+    for (int k = 1; k < 8; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint16_t prev16 = crc16Table[k - 1][b];
+            uint32_t prev32 = crc32cTable[k - 1][b];
+            crc16Table[k][b] = (prev16 << 8) ^ crc16Table[0][prev16 >> 8];
+            crc32cTable[k][b] = (prev32 >> 8) ^ crc32cTable[0][prev32 & 0xFF];
+        }
+    }
+
+    tablesReady = true;
+}
+
+/**
+ * @brief XOR of all bytes (BCC2), folded from 64-bit words.
+ */
+unsigned char xorChecksum(const unsigned char *data, int size)
+{
+    uint64_t acc = 0;
+    int i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        acc ^= word;
+    }
+    acc ^= acc >> 32;
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+
+    unsigned char bcc = acc & 0xFF;
+    for (; i < size; i++) bcc ^= data[i];
+    return bcc;
+}
+
+/**
+ * @brief Runs the CRC-16/CCITT-FALSE register over size more bytes, slice-by-8.
+ */
+static uint16_t crc16Update(uint16_t crc, const unsigned char *data, int size)
+{
+    if (!tablesReady) initTables();
+
+    int i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        const unsigned char *p = data + i;
+        unsigned char hi = (crc >> 8) ^ p[0];
+        unsigned char lo = (crc & 0xFF) ^ p[1];
+        crc = crc16Table[7][hi] ^ crc16Table[6][lo] ^
+              crc16Table[5][p[2]] ^ crc16Table[4][p[3]] ^
+              crc16Table[3][p[4]] ^ crc16Table[2][p[5]] ^
+              crc16Table[1][p[6]] ^ crc16Table[0][p[7]];
+    }
+
+    for (; i < size; i++) {
+        crc = (crc << 8) ^ crc16Table[0][(crc >> 8) ^ data[i]];
+    }
+    return crc;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE.
+ */
+uint16_t crc16Ccitt(const unsigned char *data, int size)
+{
+    return crc16Update(CRC16_INIT, data, size);
+}
+
+/**
+ * @brief Runs the CRC-32C register (not inverted) over size more bytes,
+ * slice-by-8 (little-endian word loads).
+ */
+static uint32_t crc32cSoftwareUpdate(uint32_t crc, const unsigned char *data, int size)
+{
+    if (!tablesReady) initTables();
+
+    int i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        const unsigned char *p = data + i;
+        uint32_t low = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+        crc = crc32cTable[7][low & 0xFF] ^ crc32cTable[6][(low >> 8) & 0xFF] ^
+              crc32cTable[5][(low >> 16) & 0xFF] ^ crc32cTable[4][low >> 24] ^
+              crc32cTable[3][p[4]] ^ crc32cTable[2][p[5]] ^
+              crc32cTable[1][p[6]] ^ crc32cTable[0][p[7]];
+    }
+
+    for (; i < size; i++) {
+        crc = (crc >> 8) ^ crc32cTable[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+/**
+ * @brief CRC-32C, table-driven.
+ */
+uint32_t crc32cSoftware(const unsigned char *data, int size)
+{
+    return ~crc32cSoftwareUpdate(CRC32C_INIT, data, size);
+}
+
+#ifdef HAVE_X86_CRC32
+
+/**
+ * @brief Runs the CRC-32C register with the SSE4.2 CRC32 instruction, 8 bytes per instruction.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSSE42Update(uint32_t initial, const unsigned char *data, int size)
+{
+    uint64_t crc = initial;
+    int i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+
+    uint32_t crc32 = (uint32_t)crc;
+    for (; i < size; i++) {
+        crc32 = _mm_crc32_u8(crc32, data[i]);
+    }
+    return crc32;
+}
+
+#endif // HAVE_X86_CRC32
+
+// -1: not checked yet, 0: no CRC32 instruction, 1: available
+static int hardwareCrc = -1;
+
+/**
+ * @brief Runs the CRC-32C register with the fastest kernel available.
+ */
+static uint32_t crc32cUpdate(uint32_t crc, const unsigned char *data, int size)
+{
+#ifdef HAVE_X86_CRC32
+    if (hardwareCrc < 0) {
+        __builtin_cpu_init();
+        hardwareCrc = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if (hardwareCrc) return crc32cSSE42Update(crc, data, size);
+#endif
+    return crc32cSoftwareUpdate(crc, data, size);
+}
+
+uint32_t crc32cHardware(const unsigned char *data, int size)
+{
+    return ~crc32cUpdate(CRC32C_INIT, data, size);
+}
+
+uint32_t crc32c(const unsigned char *data, int size)
+{
+    return crc32cHardware(data, size);
+}
+
+int fcsSize(FcsType type)
+{
+    switch (type) {
+        case FCS_CRC16:  return 2;
+        case FCS_CRC32C: return 4;
+        default:         return 1;
+    }
+}
+
+const char *fcsName(FcsType type)
+{
+    switch (type) {
+        case FCS_CRC16:  return "crc16";
+        case FCS_CRC32C: return "crc32c";
+        default:         return "xor";
+    }
+}
+
+/**
+ * @brief Computes the trailer of an I-frame.
+ *
+ * @param type FCS in use on the link.
+ * @param data Data field (before stuffing).
+ * @param size Size of the data field.
+ * @param out Receives fcsSize(type) bytes.
+ */
+void computeFcs(FcsType type, const unsigned char *data, int size, unsigned char *out)
+{
+    FcsState state;
+    initFcs(&state, type);
+    updateFcs(&state, data, size);
+    finishFcs(&state, out);
+}
+
+void initFcs(FcsState *state, FcsType type)
+{
+    state->type = type;
+    switch (type) {
+        case FCS_CRC16: state->reg = CRC16_INIT; break;
+        case FCS_CRC32C: state->reg = CRC32C_INIT; break;
+        default: state->reg = 0; break;
+    }
+}
+
+void updateFcs(FcsState *state, const unsigned char *data, int size)
+{
+    switch (state->type) {
+        case FCS_CRC16: state->reg = crc16Update(state->reg, data, size); break;
+        case FCS_CRC32C: state->reg = crc32cUpdate(state->reg, data, size); break;
+        default: state->reg ^= xorChecksum(data, size); break;
+    }
+}
+
+/**
+ * @brief Writes the trailer of the bytes fed to updateFcs.
+ *
+ * @param out Receives fcsSize(state->type) bytes.
+ */
+void finishFcs(const FcsState *state, unsigned char *out)
+{
+    switch (state->type) {
+        case FCS_CRC16:
+            out[0] = state->reg >> 8;
+            out[1] = state->reg & 0xFF;
+            break;
+        case FCS_CRC32C: {
+            uint32_t crc = ~state->reg;
+            out[0] = crc & 0xFF;
+            out[1] = (crc >> 8) & 0xFF;
+            out[2] = (crc >> 16) & 0xFF;
+            out[3] = crc >> 24;
+            break;
+        }
+        default:
+            out[0] = state->reg;
+            break;
+    }
+}
@@ -0,0 +1,52 @@
+// Frame check sequence (FCS) of I-frames.
+// The trailer after the data field is one of:
+//   FCS_XOR    : 1 byte, XOR of the data bytes (the original BCC2)
+//   FCS_CRC16  : 2 bytes, CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), MSB first
+//   FCS_CRC32C : 4 bytes, CRC-32C (Castagnoli, reflected poly 0x82F63B78), LSB first
+
+#ifndef _FCS_H_
+#define _FCS_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    FCS_XOR,
+    FCS_CRC16,
+    FCS_CRC32C,
+} FcsType;
+
+// Largest trailer, used to size the frame buffers
+#define FCS_MAX_SIZE 4
+
+// Number of trailer bytes for an FCS type.
+int fcsSize(FcsType type);
+
+// Name of an FCS type ("xor", "crc16", "crc32c").
+const char *fcsName(FcsType type);
+
+// Compute the FCS of size bytes of data and write its fcsSize(type) bytes to out.
+void computeFcs(FcsType type, const unsigned char *data, int size, unsigned char *out);
+
+// Running FCS, for data that is not contiguous (e.g. a packet header and a file slice).
+typedef struct
+{
+    FcsType type;
+    uint32_t reg;   // CRC register, or the XOR so far
+} FcsState;
+
+// Start a running FCS, feed it any number of blocks, then write the trailer to out.
+void initFcs(FcsState *state, FcsType type);
+void updateFcs(FcsState *state, const unsigned char *data, int size);
+void finishFcs(const FcsState *state, unsigned char *out);
+
+// Kernels. The table-driven ones process 8 bytes per step (slice-by-8).
+// crc32cHardware uses the SSE4.2 CRC32 instruction and falls back to the
+// table-driven version when the CPU does not have it; crc32c picks the best one.
+unsigned char xorChecksum(const unsigned char *data, int size);
+uint16_t crc16Ccitt(const unsigned char *data, int size);
+uint32_t crc32cSoftware(const unsigned char *data, int size);
+uint32_t crc32cHardware(const unsigned char *data, int size);
+uint32_t crc32c(const unsigned char *data, int size);
+
+#endif // _FCS_H_
@@ -0,0 +1,476 @@
+// Batch session implementation
+
+#include "file_batch.h"
+#include "packet_types.h"
+#include "prefetch.h"
+#include "statistics.h"
+#include "write_behind.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct
+{
+    char name[256];
+    long long size;
+    unsigned char *data;    // Mapping of the file (transmitter), NULL if empty
+} BatchFile;
+
+static BatchFile *files = NULL;
+static int fileCount = 0;
+static long long totalBytes = 0;
+static int current = 0;             // File the stream is in
+
+// Transmitter
+static long long position = 0;      // Offset of the stream in the current file
+static int manifestNext = 0;        // First file not yet in a manifest packet
+static bool manifestStarted = false;
+static unsigned char *packBuffers[MAX_PACK_BUFFERS];
+static int nextPack = 0;
+
+// Receiver
+static int expectedFiles = -1;      // From T_FILE_COUNT, -1 before the first manifest packet
+static char outputDir[256];
+static FILE *output = NULL;
+static long long outputLeft = 0;
+static long long streamPosition = 0;  // Bytes of the stream written so far
+// The writer thread writes the files; the main thread follows the same stream
+// as it queues the blocks, for the log and stats (see countBatchData)
+static int announced = 0;           // Files already announced in the log
+static long long announcedLeft = 0; // Bytes of the last one still to be queued
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(((const BatchFile *)a)->name, ((const BatchFile *)b)->name);
+}
+
+// =================================================================
+// Transmitter
+// =================================================================
+
+/**
+ * @brief Lists and maps the regular files of a directory.
+ *
+ * Subdirectories and other entries are skipped. The files are sorted by name
+ * so that both ends see the same order in the logs.
+ *
+ * @param directory Directory to send.
+ * @param maxBlockSize Largest block that nextBatchBlock will be asked for.
+ * @param totalSize Receives the sum of the file sizes.
+ * @return The number of files, or -1 on error.
+ */
+int openBatch(const char *directory, int maxBlockSize, long long *totalSize)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        perror("opendir");
+        return -1;
+    }
+
+    files = NULL;
+    fileCount = 0;
+    int capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char path[600];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (fileCount == MAX_BATCH_FILES) {
+            printf("TX: ERROR -> More than %d files in \"%s\"\n", MAX_BATCH_FILES, directory);
+            closedir(dir);
+            closeBatch();
+            return -1;
+        }
+        // The list grows with the files found, up to MAX_BATCH_FILES entries
+        if (fileCount == capacity) {
+            capacity = (capacity > 0) ? capacity * 2 : 64;
+            if (capacity > MAX_BATCH_FILES) capacity = MAX_BATCH_FILES;
+            BatchFile *grown = realloc(files, capacity * sizeof(BatchFile));
+            if (grown == NULL) {
+                closedir(dir);
+                closeBatch();
+                return -1;
+            }
+            memset(grown + fileCount, 0, (capacity - fileCount) * sizeof(BatchFile));
+            files = grown;
+        }
+        snprintf(files[fileCount++].name, sizeof(files[0].name), "%s", entry->d_name);
+    }
+    closedir(dir);
+    qsort(files, fileCount, sizeof(BatchFile), compareNames);
+
+    totalBytes = 0;
+    for (int i = 0; i < fileCount; i++) {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%s", directory, files[i].name);
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            perror(path);
+            if (fd >= 0) close(fd);
+            closeBatch();
+            return -1;
+        }
+
+        files[i].size = st.st_size;
+        if (files[i].size > 0) {
+            files[i].data = mmap(NULL, files[i].size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (files[i].data == MAP_FAILED) {
+                perror("mmap");
+                files[i].data = NULL;
+                close(fd);
+                closeBatch();
+                return -1;
+            }
+            madvise(files[i].data, files[i].size, MADV_SEQUENTIAL);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            addPrefetchRegion(files[i].data, files[i].size);
+        }
+        close(fd);
+        totalBytes += files[i].size;
+    }
+
+    for (int i = 0; i < MAX_PACK_BUFFERS; i++) {
+        packBuffers[i] = malloc(maxBlockSize);
+        if (packBuffers[i] == NULL) {
+            closeBatch();
+            return -1;
+        }
+    }
+
+    current = 0;
+    position = 0;
+    manifestNext = 0;
+    manifestStarted = false;
+    nextPack = 0;
+    stats.filesTransferred = fileCount;
+    *totalSize = totalBytes;
+    return fileCount;
+}
+
+/**
+ * @brief Builds the next manifest packet.
+ *
+ * The packet structure is: C (1 byte: C_MANIFEST) | [TLV_COUNT] | ENTRY | ENTRY | ...
+ * The first packet starts with TLV_COUNT: T_FILE_COUNT | L (4) | V (number of files).
+ * Each ENTRY is a TLV_SIZE and a TLV_FILENAME, as in the START packet.
+ */
+int buildManifestPacket(unsigned char *packet, int maxSize)
+{
+    if (manifestStarted && manifestNext == fileCount) return 0;
+
+    int index = 0;
+    int before = manifestNext;
+    packet[index++] = C_MANIFEST;
+
+    if (!manifestStarted) {
+        packet[index++] = T_FILE_COUNT;
+        packet[index++] = 4;
+        memcpy(&packet[index], &fileCount, 4);
+        index += 4;
+    }
+
+    while (manifestNext < fileCount) {
+        const BatchFile *file = &files[manifestNext];
+        int nameLength = strlen(file->name);
+        if (index + 10 + 2 + nameLength > maxSize) break;
+
+        packet[index++] = T_FILE_SIZE;
+        packet[index++] = 8;
+        memcpy(&packet[index], &file->size, 8);
+        index += 8;
+
+        packet[index++] = T_FILE_NAME;
+        packet[index++] = nameLength;
+        memcpy(&packet[index], file->name, nameLength);
+        index += nameLength;
+        manifestNext++;
+    }
+
+    // Only the first packet may go without entries (it carries the count)
+    if (manifestStarted && manifestNext == before) {
+        printf("TX: ERROR -> \"%s\" does not fit in a manifest packet\n", files[manifestNext].name);
+        return -1;
+    }
+    manifestStarted = true;
+    return index;
+}
+
+/**
+ * @brief Takes the next size bytes of the stream.
+ *
+ * Inside a file the block is a slice of its mapping, as for a single file.
+ * A block that crosses the end of a file is packed into one of the pack
+ * buffers together with the start of the following files.
+ */
+const unsigned char *nextBatchBlock(int size)
+{
+    while (current < fileCount && position == files[current].size) {
+        current++;
+        position = 0;
+    }
+
+    if (current < fileCount && files[current].size - position >= size) {
+        const unsigned char *block = files[current].data + position;
+        position += size;
+        return block;
+    }
+
+    unsigned char *pack = packBuffers[nextPack];
+    nextPack = (nextPack + 1) % MAX_PACK_BUFFERS;
+
+    int filled = 0;
+    int filesInBlock = 0;
+    while (filled < size && current < fileCount) {
+        long long left = files[current].size - position;
+        int n = (left < size - filled) ? left : size - filled;
+        if (n > 0) {
+            memcpy(pack + filled, files[current].data + position, n);
+            filled += n;
+            position += n;
+            filesInBlock++;
+        }
+        if (position == files[current].size) {
+            current++;
+            position = 0;
+        }
+    }
+    if (filesInBlock > 1) stats.packetsShared++;
+    return pack;
+}
+
+void closeBatch()
+{
+    stopPrefetch();     // It reads the mappings
+    for (int i = 0; i < fileCount && files != NULL; i++) {
+        if (files[i].data != NULL) munmap(files[i].data, files[i].size);
+    }
+    free(files);
+    files = NULL;
+    fileCount = 0;
+
+    for (int i = 0; i < MAX_PACK_BUFFERS; i++) {
+        free(packBuffers[i]);
+        packBuffers[i] = NULL;
+    }
+}
+
+// =================================================================
+// Receiver
+// =================================================================
+
+/**
+ * @brief Opens the next file of the manifest that has data; empty files are just created.
+ */
+static int openNextOutput()
+{
+    while (current < fileCount) {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%s", outputDir, files[current].name);
+        output = fopen(path, "wb");
+        if (output == NULL) {
+            perror(path);
+            return -1;
+        }
+        outputLeft = files[current].size;
+        if (outputLeft > 0) {
+            preallocateFile(output, outputLeft);
+            return 0;
+        }
+
+        fclose(output);
+        output = NULL;
+        current++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Logs the next files of the manifest, up to the first one with data (main thread).
+ */
+static void announceNextFiles()
+{
+    while (announced < fileCount) {
+        printf("RX: Receiving \"%s/%s\" (%lld bytes)\n", outputDir, files[announced].name,
+               files[announced].size);
+        announcedLeft = files[announced++].size;
+        if (announcedLeft > 0) return;
+    }
+}
+
+/**
+ * @brief A name from the manifest must stay inside the output directory.
+ */
+static bool validName(const char *name)
+{
+    return name[0] != '\0' && strchr(name, '/') == NULL &&
+           strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+}
+
+/**
+ * @brief Adds the entries of a manifest packet (see buildManifestPacket).
+ *
+ * When the last entry arrives the output directory is created and the first
+ * file opened.
+ */
+int addManifestEntries(const char *directory, const unsigned char *packet, int size)
+{
+    long long entrySize = -1;
+    bool valid = true;
+    int index = 1;
+
+    while (valid && index + 2 <= size) {
+        unsigned char T = packet[index++];
+        unsigned char L = packet[index++];
+        if (index + L > size) {
+            valid = false;
+        }
+        else if (T == T_FILE_COUNT && L == 4 && expectedFiles < 0) {
+            memcpy(&expectedFiles, &packet[index], 4);
+            if (expectedFiles < 0 || expectedFiles > MAX_BATCH_FILES) {
+                expectedFiles = -1;
+                valid = false;
+                break;
+            }
+
+            files = calloc(expectedFiles > 0 ? expectedFiles : 1, sizeof(BatchFile));
+            if (files == NULL) return -1;
+            fileCount = 0;
+            totalBytes = 0;
+            current = 0;
+            streamPosition = 0;
+            snprintf(outputDir, sizeof(outputDir), "%s", directory);
+        }
+        else if (T == T_FILE_SIZE && L == 8) {
+            memcpy(&entrySize, &packet[index], 8);
+        }
+        else if (T == T_FILE_NAME && expectedFiles >= 0 && entrySize >= 0 && fileCount < expectedFiles) {
+            BatchFile *file = &files[fileCount];
+            memcpy(file->name, &packet[index], L);
+            file->name[L] = '\0';
+            valid = validName(file->name);
+
+            file->size = entrySize;
+            totalBytes += entrySize;
+            fileCount++;
+            entrySize = -1;
+        }
+        else {
+            valid = false;
+        }
+        index += L;
+    }
+
+    if (!valid || index != size || expectedFiles < 0) {
+        printf("RX: ERROR -> Invalid manifest packet\n");
+        return -1;
+    }
+
+    if (fileCount == expectedFiles) {
+        printf("RX: Batch of %d files (%lld bytes) into \"%s\"\n", fileCount, totalBytes, outputDir);
+        if (mkdir(outputDir, 0755) != 0 && errno != EEXIST) {
+            perror("mkdir");
+            return -1;
+        }
+        stats.filesTransferred = fileCount;
+        announced = 0;
+        announcedLeft = 0;
+        announceNextFiles();
+        return openNextOutput();
+    }
+    return 0;
+}
+
+bool batchStarted()
+{
+    return expectedFiles >= 0;
+}
+
+/**
+ * @brief Splits a block of the stream over the files it belongs to.
+ *
+ * The files are written one after the other, so the blocks must come in order.
+ */
+int writeBatchData(long long offset, const unsigned char *data, int size)
+{
+    if (fileCount != expectedFiles) {
+        printf("RX: ERROR -> Data before the end of the manifest\n");
+        return -1;
+    }
+    if (offset != streamPosition) {
+        printf("RX: ERROR -> Batch data at %lld, expected %lld\n", offset, streamPosition);
+        return -1;
+    }
+    streamPosition += size;
+
+    int filesInBlock = 0;
+    while (size > 0) {
+        if (output == NULL) {
+            printf("RX: ERROR -> More data than the manifest announced\n");
+            return -1;
+        }
+
+        int n = (outputLeft < size) ? outputLeft : size;
+        if (fwrite(data, 1, n, output) != n) {
+            printf("RX: ERROR ->  Failed to write data to file\n");
+            return -1;
+        }
+        data += n;
+        size -= n;
+        outputLeft -= n;
+        filesInBlock++;
+
+        if (outputLeft == 0) {
+            if (fclose(output) != 0) {
+                perror("fclose");
+                output = NULL;
+                return -1;
+            }
+            output = NULL;
+            current++;
+            if (openNextOutput() < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+void countBatchData(int size)
+{
+    int filesInBlock = 0;
+    while (size > 0 && announcedLeft > 0) {
+        int n = (announcedLeft < size) ? announcedLeft : size;
+        size -= n;
+        announcedLeft -= n;
+        filesInBlock++;
+        if (announcedLeft == 0) announceNextFiles();
+    }
+    if (filesInBlock > 1) stats.packetsShared++;
+}
+
+bool batchComplete()
+{
+    return expectedFiles >= 0 && fileCount == expectedFiles && current == fileCount;
+}
+
+long long batchTotalSize()
+{
+    return totalBytes;
+}
+
+void freeBatch()
+{
+    if (output != NULL) fclose(output);
+    output = NULL;
+    free(files);
+    files = NULL;
+    fileCount = 0;
+    expectedFiles = -1;
+}
@@ -0,0 +1,63 @@
+// Batch sessions: many files over one connection.
+// The transmitter sends the regular files of a directory (sorted by name)
+// after a manifest of their names and sizes, one C_MANIFEST packet or more.
+// The data packets then carry the files back to back as one stream, so the
+// end of a file and the start of the next ones share a packet; the receiver
+// splits the stream again using the sizes in the manifest.
+
+#ifndef _FILE_BATCH_H_
+#define _FILE_BATCH_H_
+
+#include <stdbool.h>
+#include "compress_pool.h"
+
+// Largest number of files in a batch
+#define MAX_BATCH_FILES 65536
+
+// Buffers for blocks that span several files: one per block the compression pool can hold
+#define MAX_PACK_BUFFERS (MAX_COMPRESS_THREADS * BLOCKS_PER_THREAD)
+
+// ---- Transmitter ----
+
+// Map the regular files of directory for blocks of up to maxBlockSize bytes.
+// Sets *totalSize to the sum of their sizes. Returns the number of files or -1 on error.
+int openBatch(const char *directory, int maxBlockSize, long long *totalSize);
+
+// Build the next manifest packet of at most maxSize bytes.
+// Returns its size, 0 once the whole manifest was built, or -1 on error.
+int buildManifestPacket(unsigned char *packet, int maxSize);
+
+// The next size bytes of the stream: a slice of a mapped file, or a copy when
+// they span several files. Stays valid for the next MAX_PACK_BUFFERS - 1 calls.
+const unsigned char *nextBatchBlock(int size);
+
+// Unmap the files and release the buffers.
+void closeBatch();
+
+// ---- Receiver ----
+
+// Add the entries of a manifest packet; files are written in directory.
+// Returns 0 on success or -1 on an invalid manifest.
+int addManifestEntries(const char *directory, const unsigned char *packet, int size);
+
+// TRUE once a manifest packet arrived.
+bool batchStarted();
+
+// Write size bytes found at offset in the stream into the files they belong to.
+// Returns 0 on success or -1 on error (also if offset is not where the stream is).
+int writeBatchData(long long offset, const unsigned char *data, int size);
+
+// Follow a block of size bytes queued for writeBatchData, on the main thread:
+// logs the files it starts and counts it in stats.packetsShared if it spans several.
+void countBatchData(int size);
+
+// TRUE if the whole manifest arrived and every file was written.
+bool batchComplete();
+
+// Sum of the file sizes in the manifest.
+long long batchTotalSize();
+
+// Close the file being written and release the manifest.
+void freeBatch();
+
+#endif // _FILE_BATCH_H_
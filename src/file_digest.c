@@ -0,0 +1,131 @@
+// File digest implementation (XXH64)
+
+#include "file_digest.h"
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t mergeRound(uint64_t h, uint64_t acc)
+{
+    h ^= round64(0, acc);
+    return h * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @brief Consumes one 32-byte stripe: 8 bytes into each of the four lanes.
+ *
+ * The lanes are independent, so the CPU overlaps their multiplications;
+ * this runs at several GB/s, far above any serial line.
+ */
+static void processStripe(uint64_t acc[4], const unsigned char *p)
+{
+    acc[0] = round64(acc[0], read64(p));
+    acc[1] = round64(acc[1], read64(p + 8));
+    acc[2] = round64(acc[2], read64(p + 16));
+    acc[3] = round64(acc[3], read64(p + 24));
+}
+
+void initDigest(DigestState *state)
+{
+    state->acc[0] = PRIME64_1 + PRIME64_2;
+    state->acc[1] = PRIME64_2;
+    state->acc[2] = 0;
+    state->acc[3] = -PRIME64_1;
+    state->totalLength = 0;
+    state->buffered = 0;
+}
+
+void updateDigest(DigestState *state, const unsigned char *data, int size)
+{
+    state->totalLength += size;
+
+    // Complete a stripe left over from the previous block
+    if (state->buffered > 0) {
+        int n = 32 - state->buffered;
+        if (n > size) n = size;
+        memcpy(state->buffer + state->buffered, data, n);
+        state->buffered += n;
+        data += n;
+        size -= n;
+        if (state->buffered < 32) return;
+        processStripe(state->acc, state->buffer);
+        state->buffered = 0;
+    }
+
+    for (; size >= 32; data += 32, size -= 32) processStripe(state->acc, data);
+
+    memcpy(state->buffer, data, size);
+    state->buffered = size;
+}
+
+/**
+ * @brief Folds the lanes and the buffered tail into the final value.
+ *
+ * The state is not modified, so a digest can be read in the middle of a transfer.
+ */
+uint64_t finishDigest(const DigestState *state)
+{
+    uint64_t h;
+    if (state->totalLength >= 32) {
+        h = rotl64(state->acc[0], 1) + rotl64(state->acc[1], 7) +
+            rotl64(state->acc[2], 12) + rotl64(state->acc[3], 18);
+        for (int i = 0; i < 4; i++) h = mergeRound(h, state->acc[i]);
+    } else {
+        h = state->acc[2] + PRIME64_5;     // acc[2] still holds the seed
+    }
+    h += state->totalLength;
+
+    const unsigned char *p = state->buffer;
+    int left = state->buffered;
+    for (; left >= 8; p += 8, left -= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (left >= 4) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; p++, left--) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
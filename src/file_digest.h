@@ -0,0 +1,23 @@
+// End-to-end digest of the file data: XXH64 (xxHash, 64 bits, seed 0).
+// Both ends feed it the file bytes in order as they are sent and written;
+// the transmitter puts its value in the END packet and the receiver compares.
+
+#ifndef _FILE_DIGEST_H_
+#define _FILE_DIGEST_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t acc[4];            // Lane accumulators
+    uint64_t totalLength;
+    unsigned char buffer[32];   // Bytes of an incomplete 32-byte stripe
+    int buffered;
+} DigestState;
+
+// Start a digest, feed it any number of blocks, then read the value.
+void initDigest(DigestState *state);
+void updateDigest(DigestState *state, const unsigned char *data, int size);
+uint64_t finishDigest(const DigestState *state);
+
+#endif // _FILE_DIGEST_H_
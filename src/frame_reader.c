@@ -0,0 +1,169 @@
+// Buffered receive engine implementation
+
+#include "frame_reader.h"
+#include "profiler.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FLAG 0x7E
+
+extern int fd;
+
+/*
+ * Bytes read from the serial port wait in rxBuffer[rxHead, rxTail). They are always
+ * consumed before the next read(), so the buffer restarts at offset 0 on every refill.
+ * The body of the frame being received is assembled in frameBuffer, which keeps
+ * partial frames across calls (the transmitter polls for acknowledgements between
+ * writes and may see half a frame).
+ */
+static unsigned char rxBuffer[RX_BUFFER_SIZE];
+static int rxHead = 0;
+static int rxTail = 0;
+
+static unsigned char *frameBuffer = NULL;
+static int frameCapacity = 0;
+static int frameLength = 0;
+static bool inFrame = false;    // An opening FLAG was seen
+static bool overflow = false;   // Current frame exceeded frameCapacity and is being dropped
+static int returnedLength = 0;  // Body size of the last frame returned
+static bool pushedBack = false; // unreadFrame was called
+
+static EventLoop *eventLoop = NULL;
+
+/**
+ * @brief Allocates the frame assembly buffer and resets the receive state.
+ *
+ * @param maxFrameSize Largest frame body accepted.
+ * @param loop Event loop of the link; the serial port is added to it.
+ * @return 0 on success, -1 if memory could not be allocated or fd could not be watched.
+ */
+int initFrameReader(int maxFrameSize, EventLoop *loop)
+{
+    if (watchFd(loop, fd) < 0) return -1;
+    eventLoop = loop;
+
+    free(frameBuffer);
+    frameBuffer = malloc(maxFrameSize);
+    if (frameBuffer == NULL) return -1;
+
+    frameCapacity = maxFrameSize;
+    frameLength = 0;
+    inFrame = false;
+    overflow = false;
+    pushedBack = false;
+    rxHead = rxTail = 0;
+    return 0;
+}
+
+/**
+ * @brief Releases the assembly buffer and drops any buffered bytes.
+ */
+void freeFrameReader()
+{
+    free(frameBuffer);
+    frameBuffer = NULL;
+    frameCapacity = 0;
+    rxHead = rxTail = 0;
+    eventLoop = NULL;
+}
+
+/**
+ * @brief Refills rxBuffer with as many bytes as the serial port has ready.
+ *
+ * @param block If FALSE, returns immediately when no byte is available.
+ *              If TRUE, waits for bytes or for a timer of the event loop.
+ * @return Number of bytes read, 0 if none (or a timer expired), -1 on error.
+ */
+static int fillBuffer(bool block)
+{
+    if (block) PROFILE_BEGIN(PROF_IO_WAIT);
+    int events = waitEvents(eventLoop, block ? -1 : 0);
+    if (block) PROFILE_END(PROF_IO_WAIT);
+    if (events < 0) return -1;
+    if (!fdReadable(eventLoop, fd)) return 0;
+
+    int n = read(fd, rxBuffer, RX_BUFFER_SIZE);
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        perror("read");
+        return -1;
+    }
+
+    rxHead = 0;
+    rxTail = n;
+    return n;
+}
+
+/**
+ * @brief Returns the next complete frame body found in the byte stream.
+ *
+ * memchr jumps straight to the next FLAG and the bytes in between are copied
+ * as one block. A closing FLAG is left in the buffer so it can also open the
+ * next frame; the empty body this produces between back-to-back flags is skipped.
+ *
+ * @param body Set to the frame body on success.
+ * @param block Whether to wait for more bytes when no complete frame is buffered.
+ * @return The body size, 0 if no frame is available, or -1 on error.
+ */
+int readFrame(const unsigned char **body, bool block)
+{
+    // The body of a frame handed back stays in frameBuffer until the next frame starts
+    if (pushedBack) {
+        pushedBack = false;
+        *body = frameBuffer;
+        return returnedLength;
+    }
+
+    while (true) {
+        while (rxHead < rxTail) {
+            unsigned char *start = rxBuffer + rxHead;
+            unsigned char *flag = memchr(start, FLAG, rxTail - rxHead);
+
+            if (!inFrame) {
+                // Discard everything up to the opening FLAG
+                if (flag == NULL) {
+                    rxHead = rxTail;
+                    break;
+                }
+                rxHead = flag - rxBuffer + 1;
+                inFrame = true;
+                frameLength = 0;
+                overflow = false;
+                continue;
+            }
+
+            int end = (flag != NULL) ? flag - rxBuffer : rxTail;
+            int n = end - rxHead;
+            if (!overflow && frameLength + n > frameCapacity) overflow = true;
+            if (!overflow) {
+                memcpy(frameBuffer + frameLength, start, n);
+                frameLength += n;
+            }
+            rxHead = end;
+
+            if (flag != NULL) {
+                inFrame = false;
+                if (frameLength > 0 && !overflow) {
+                    *body = frameBuffer;
+                    returnedLength = frameLength;
+                    return frameLength;
+                }
+            }
+        }
+
+        int n = fillBuffer(block);
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+    }
+}
+
+/**
+ * @brief Hands the last frame back, for a caller that read a frame meant for someone else.
+ */
+void unreadFrame()
+{
+    pushedBack = true;
+}
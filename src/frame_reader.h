@@ -0,0 +1,36 @@
+// Buffered receive engine for the link layer.
+// Pulls every byte the serial port has ready with a single read() and splits
+// the stream into frames delimited by FLAG. Waits go through the link's event
+// loop, so an expired timer ends them.
+
+#ifndef _FRAME_READER_H_
+#define _FRAME_READER_H_
+
+#include <stdbool.h>
+#include "event_loop.h"
+
+// Bytes requested from the serial port per read() call
+#define RX_BUFFER_SIZE 4096
+
+// Allocate the frame assembly buffer and register the serial port in loop.
+// Frames whose body is longer than maxFrameSize are discarded.
+// Returns 0 on success or -1 on error.
+int initFrameReader(int maxFrameSize, EventLoop *loop);
+
+// Release the assembly buffer and drop any buffered bytes.
+void freeFrameReader();
+
+// Get the next frame from the serial port.
+// On success *body points to the bytes between the opening and closing FLAG
+// (address, control, BCC1 and, for I-frames, the still-stuffed data and BCC2).
+// The pointer is valid until the next call.
+// If block is TRUE, waits for bytes when no complete frame is buffered, until
+// a timer of the loop expires; if FALSE, only uses the bytes that are already available.
+// Returns the body size, 0 if no frame is available (or a timer expired first),
+// or -1 on error.
+int readFrame(const unsigned char **body, bool block);
+
+// Make the next readFrame return the frame it returned last, again.
+void unreadFrame();
+
+#endif // _FRAME_READER_H_
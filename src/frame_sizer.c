@@ -0,0 +1,176 @@
+// Adaptive data packet size implementation
+
+#include "frame_sizer.h"
+#include "fcs.h"
+#include "link_layer.h"
+#include "link_config.h"
+#include "packet_types.h"
+#include "statistics.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Bytes added to each chunk on the line: frame header (F, A, C, BCC1) and closing
+// flag; the data packet header and the FCS in use are added at init
+#define FRAME_OVERHEAD (4 + 1)
+
+// Weight kept by the older counts at each decision
+#define ERROR_MEMORY 0.85
+
+static bool adaptive = true;
+static int maxChunk = 0;
+static int currentChunk = 0;
+static int overhead = FRAME_OVERHEAD + DATA_HEADER_SIZE;
+static double byteTime = 0;      // Seconds per byte on the line
+static double maxFrameErrorRate = 1;  // Largest frame error probability allowed
+
+static int packetsSinceDecision = 0;
+static int lastAttempts = 0;     // framesTransmitted + framesRetransmitted at the last decision
+static int lastErrors = 0;       // rejReceived + timeouts at the last decision
+static double errorCount = 0;    // Frame errors, aged by ERROR_MEMORY
+static double byteCount = 0;     // Frame bytes sent, aged by ERROR_MEMORY
+static double byteErrorRate = 0;
+
+/**
+ * @brief x^n for a non-negative integer n (keeps the program free of libm).
+ */
+static double powInt(double x, int n)
+{
+    double result = 1.0;
+    while (n > 0) {
+        if (n & 1) result *= x;
+        x *= x;
+        n >>= 1;
+    }
+    return result;
+}
+
+/**
+ * @brief Expected line time per delivered data byte for a chunk size.
+ *
+ * Go-Back-N also sends again the frames that followed a damaged one: the window
+ * is written ahead into the serial port, so by the time the REJ arrives the rest
+ * of the window is already on its way.
+ */
+static double costPerByte(int chunk, double ber, double frameTime)
+{
+    int frameSize = chunk + overhead;
+    double success = powInt(1 - ber, frameSize);
+    if (success <= 0) return 1e30;
+
+    double lostFrames = (linkConfig.arqMode == ARQ_GO_BACK_N) ? linkConfig.windowSize - 1 : 0;
+    double sendTime = frameSize * byteTime * (1 + (1 - success) * lostFrames);
+    return (sendTime + frameTime) / (chunk * success);
+}
+
+/**
+ * @brief Chunk size with the lowest cost for the current estimate.
+ *
+ * Sizes are tried in steps of about 6%, which is finer than the estimate, up to
+ * twice the current size and never above the retry limit constraint.
+ */
+static int bestChunkSize()
+{
+    // Stop-and-Wait waits a round trip for the RR of every frame;
+    // the window modes overlap it with the next frames
+    double frameTime = 0;
+    if (linkConfig.arqMode == ARQ_STOP_AND_WAIT) frameTime = stats.srttMs / 1000.0;
+
+    int limit = (currentChunk < maxChunk / 2) ? currentChunk * 2 : maxChunk;
+    int best = MIN_CHUNK_SIZE;
+    double bestCost = costPerByte(MIN_CHUNK_SIZE, byteErrorRate, frameTime);
+
+    for (int chunk = MIN_CHUNK_SIZE; chunk <= limit; chunk += chunk / 16 + 1) {
+        if (chunk + chunk / 16 + 1 > limit) chunk = limit;
+        if (1 - powInt(1 - byteErrorRate, chunk + overhead) > maxFrameErrorRate) break;
+
+        double cost = costPerByte(chunk, byteErrorRate, frameTime);
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = chunk;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Resets the sizer for a new transfer.
+ *
+ * @param maxChunkSize Largest chunk (agreed payload minus the data packet header).
+ * @param baudRate Line rate, for the time each byte takes.
+ * @param nTries Copies of a frame the link sends before giving up.
+ */
+void initFrameSizer(int maxChunkSize, int baudRate, int nTries)
+{
+    const char *env = getenv("LL_ADAPTIVE");
+    adaptive = !(env != NULL && strcmp(env, "0") == 0);
+
+    maxChunk = maxChunkSize;
+    if (maxChunk < MIN_CHUNK_SIZE) adaptive = false;
+    // Offset-addressed data packets carry the 8-byte file offset in their header
+    int packetHeader = linkConfig.offsetData ? DATA_AT_HEADER_SIZE : DATA_HEADER_SIZE;
+    int defaultChunk = MAX_PAYLOAD_SIZE - packetHeader;
+    currentChunk = (adaptive && maxChunk > defaultChunk) ? defaultChunk : maxChunk;
+    overhead = FRAME_OVERHEAD + packetHeader + fcsSize(linkConfig.fcsType);
+    byteTime = 10.0 / baudRate;
+
+    // p^nTries <= MAX_GIVE_UP_PROBABILITY
+    double low = 0, high = 1;
+    for (int i = 0; i < 50; i++) {
+        double mid = (low + high) / 2;
+        if (powInt(mid, nTries) <= MAX_GIVE_UP_PROBABILITY) low = mid;
+        else high = mid;
+    }
+    maxFrameErrorRate = low;
+
+    packetsSinceDecision = 0;
+    lastAttempts = stats.framesTransmitted + stats.framesRetransmitted;
+    lastErrors = stats.rejReceived + stats.timeouts;
+    errorCount = 0;
+    byteCount = 0;
+    byteErrorRate = 0;
+}
+
+/**
+ * @brief Returns the size of the next data chunk.
+ *
+ * The size is revised every SIZER_INTERVAL packets, or as soon as SIZER_EARLY_ERRORS
+ * errors were seen. Errors are the REJ/SREJ and timeouts, and every frame sent (first
+ * copies and retransmissions) adds its size to the bytes exposed to errors; the byte
+ * error rate is their ratio. Older counts are aged rather than dropped, so a few
+ * clean frames do not make a noisy line look clean.
+ */
+int nextChunkSize()
+{
+    if (!adaptive) return maxChunk;
+
+    int attempts = stats.framesTransmitted + stats.framesRetransmitted;
+    int errors = stats.rejReceived + stats.timeouts;
+    int newAttempts = attempts - lastAttempts;
+    int newErrors = errors - lastErrors;
+
+    if (++packetsSinceDecision <= SIZER_INTERVAL && newErrors < SIZER_EARLY_ERRORS) return currentChunk;
+    if (newAttempts <= 0) return currentChunk;
+
+    errorCount = ERROR_MEMORY * errorCount + newErrors;
+    byteCount = ERROR_MEMORY * byteCount + (double)newAttempts * (currentChunk + overhead);
+    byteErrorRate = errorCount / byteCount;
+
+    lastAttempts = attempts;
+    lastErrors = errors;
+    packetsSinceDecision = 1;
+
+    int chunk = bestChunkSize();
+    if (chunk != currentChunk) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        double elapsed = tv.tv_sec + tv.tv_usec / 1000000.0 - stats.startTime;
+
+        printf("TX: [%.2f s] Chunk size %d -> %d bytes (%d/%d frames with errors, byte error rate %.2e)\n",
+               elapsed, currentChunk, chunk, newErrors, newAttempts, byteErrorRate);
+        currentChunk = chunk;
+    }
+    return currentChunk;
+}
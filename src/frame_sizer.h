@@ -0,0 +1,35 @@
+// Adaptive data packet size for the transmitter.
+// Every few data packets the frame error probability is estimated from the
+// REJ/SREJ and timeout counters in stats, converted to a byte error rate, and
+// the chunk size with the best expected goodput is chosen:
+//   time per useful byte = ((L + H) * t_byte * (1 + p * k) + t_frame) / (L * (1 - p))
+// with L the data bytes, H the per-frame overhead (frame and data packet headers,
+// FCS), b the byte error rate, p = 1 - (1 - b)^(L + H) the frame error probability,
+// t_frame the round trip paid per frame (Stop-and-Wait only) and k the frames sent
+// again after a damaged one (Go-Back-N only: the rest of the window).
+// The link gives up after nTries failed copies of a frame, so only sizes whose
+// frame error probability p keeps p^nTries below MAX_GIVE_UP_PROBABILITY are used.
+// The size starts at the default chunk and at most doubles per decision, so a
+// line that turns out to be noisy is measured before large frames are risked.
+
+#ifndef _FRAME_SIZER_H_
+#define _FRAME_SIZER_H_
+
+// Smallest data chunk the sizer will choose
+#define MIN_CHUNK_SIZE 32
+
+// Number of data packets between two decisions (fewer if errors pile up)
+#define SIZER_INTERVAL 8
+#define SIZER_EARLY_ERRORS 2
+
+// Acceptable probability that every copy of a frame is lost
+#define MAX_GIVE_UP_PROBABILITY 1e-3
+
+// Start a transfer. maxChunkSize is the largest chunk that fits the agreed payload.
+// The sizer is disabled (always maxChunkSize) if the environment has LL_ADAPTIVE=0.
+void initFrameSizer(int maxChunkSize, int baudRate, int nTries);
+
+// Size of the next data chunk, in bytes.
+int nextChunkSize();
+
+#endif // _FRAME_SIZER_H_
@@ -0,0 +1,65 @@
+// Latency histogram implementation
+
+#include "latency_histogram.h"
+#include <stdio.h>
+
+/**
+ * @brief Bucket of a value: its highest LATENCY_SUB_BITS + 1 bits.
+ */
+static int bucketOf(uint64_t us)
+{
+    if (us < LATENCY_SUB_BUCKETS) return us;
+
+    int shift = 63 - __builtin_clzll(us) - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)(us >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+/**
+ * @brief Largest value that falls in a bucket.
+ */
+static uint64_t bucketTop(int bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t top = bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void recordLatency(LatencyHistogram *histogram, double ms)
+{
+    uint64_t us = (ms > 0) ? (uint64_t)(ms * 1000.0) : 0;
+    if (us >= (1ull << LATENCY_MAX_BITS)) us = (1ull << LATENCY_MAX_BITS) - 1;
+
+    histogram->counts[bucketOf(us)]++;
+    histogram->samples++;
+    if (us > histogram->maxUs) histogram->maxUs = us;
+}
+
+double latencyPercentile(const LatencyHistogram *histogram, double percentile)
+{
+    if (histogram->samples == 0) return 0;
+
+    // Rank of the sample wanted, counting from 1
+    long long rank = (long long)(percentile / 100.0 * histogram->samples + 0.5);
+    if (rank < 1) rank = 1;
+
+    long long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->counts[bucket];
+        if (seen >= rank) {
+            uint64_t top = bucketTop(bucket);
+            return ((top < histogram->maxUs) ? top : histogram->maxUs) / 1000.0;
+        }
+    }
+    return histogram->maxUs / 1000.0;
+}
+
+void printLatency(const char *name, const LatencyHistogram *histogram)
+{
+    if (histogram->samples == 0) return;
+
+    printf("  %s: %lld samples, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n", name,
+           histogram->samples, latencyPercentile(histogram, 50), latencyPercentile(histogram, 90),
+           latencyPercentile(histogram, 99), histogram->maxUs / 1000.0);
+}
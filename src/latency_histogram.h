@@ -0,0 +1,37 @@
+// Latency histogram with logarithmic buckets (as in HdrHistogram).
+// Values are kept in microseconds. Below LATENCY_SUB_BUCKETS us every value
+// has its own bucket; above, each power of two is split into
+// LATENCY_SUB_BUCKETS equal buckets, so a percentile is off by at most
+// 1/LATENCY_SUB_BUCKETS (3%) whether it is 200 us or 4 s. The counts are a
+// plain array: a histogram can live in a struct that is cleared with memset.
+
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+
+// Largest value kept: 2^LATENCY_MAX_BITS - 1 us (about 12 days)
+#define LATENCY_MAX_BITS 40
+
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct
+{
+    uint32_t counts[LATENCY_BUCKETS];
+    long long samples;
+    uint64_t maxUs;
+} LatencyHistogram;
+
+// Add one measurement, in milliseconds (negative values count as 0).
+void recordLatency(LatencyHistogram *histogram, double ms);
+
+// Value in milliseconds below which percentile % of the samples are (0 if empty).
+double latencyPercentile(const LatencyHistogram *histogram, double percentile);
+
+// Print "name: n samples, p50 .. p90 .. p99 .. max .. ms" (nothing if empty).
+void printLatency(const char *name, const LatencyHistogram *histogram);
+
+#endif // _LATENCY_HISTOGRAM_H_
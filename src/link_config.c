@@ -0,0 +1,213 @@
+// Link layer runtime configuration
+
+#include "link_config.h"
+#include "link_layer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+LinkConfig linkConfig = {
+    .arqMode = ARQ_STOP_AND_WAIT,
+    .windowSize = 1,
+    .fcsType = FCS_XOR,
+    .maxPayload = MAX_PAYLOAD_SIZE,
+    .replyFrames = true,
+    .offsetData = true,
+};
+
+const LinkConfig legacyLinkConfig = {
+    .arqMode = ARQ_STOP_AND_WAIT,
+    .windowSize = 1,
+    .fcsType = FCS_XOR,
+    .maxPayload = MAX_PAYLOAD_SIZE,
+    .replyFrames = false,
+    .offsetData = false,
+};
+
+/**
+ * @brief Loads the link layer configuration from environment variables.
+ *
+ * These are the values this end proposes (or accepts) in llopen. Invalid values
+ * are reported and replaced by the defaults.
+ */
+void loadLinkConfig() {
+    const char *arq = getenv("LL_ARQ");
+    const char *window = getenv("LL_WINDOW");
+    const char *fcs = getenv("LL_FCS");
+    const char *payload = getenv("LL_PAYLOAD");
+
+    linkConfig.arqMode = ARQ_STOP_AND_WAIT;
+    linkConfig.windowSize = 1;
+    linkConfig.fcsType = FCS_XOR;
+    linkConfig.maxPayload = MAX_PAYLOAD_SIZE;
+    linkConfig.replyFrames = true;
+    linkConfig.offsetData = true;
+
+    if (payload != NULL) {
+        int size = atoi(payload);
+        if (size >= MIN_LINK_PAYLOAD_SIZE && size <= MAX_LINK_PAYLOAD_SIZE) {
+            linkConfig.maxPayload = size;
+        } else {
+            printf("CONFIG: LL_PAYLOAD must be between %d and %d, using %d\n",
+                   MIN_LINK_PAYLOAD_SIZE, MAX_LINK_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+        }
+    }
+
+    if (fcs != NULL) {
+        if (strcmp(fcs, "crc16") == 0) {
+            linkConfig.fcsType = FCS_CRC16;
+        } else if (strcmp(fcs, "crc32c") == 0) {
+            linkConfig.fcsType = FCS_CRC32C;
+        } else if (strcmp(fcs, "xor") != 0) {
+            printf("CONFIG: Unknown LL_FCS \"%s\", using BCC2 (xor)\n", fcs);
+        }
+    }
+
+    if (arq != NULL) {
+        if (strcmp(arq, "gbn") == 0) {
+            linkConfig.arqMode = ARQ_GO_BACK_N;
+        } else if (strcmp(arq, "sr") == 0) {
+            linkConfig.arqMode = ARQ_SELECTIVE_REPEAT;
+        } else if (strcmp(arq, "saw") != 0) {
+            printf("CONFIG: Unknown LL_ARQ \"%s\", using Stop-and-Wait\n", arq);
+        }
+    }
+
+    if (linkConfig.arqMode == ARQ_STOP_AND_WAIT) return;
+
+    int maxWindow = (linkConfig.arqMode == ARQ_SELECTIVE_REPEAT) ? MAX_SR_WINDOW_SIZE : MAX_WINDOW_SIZE;
+
+    linkConfig.windowSize = DEFAULT_WINDOW_SIZE;
+    if (window != NULL) {
+        int size = atoi(window);
+        if (size >= 1 && size <= maxWindow) {
+            linkConfig.windowSize = size;
+        } else {
+            printf("CONFIG: LL_WINDOW must be between 1 and %d, using %d\n", maxWindow, DEFAULT_WINDOW_SIZE);
+        }
+    }
+}
+
+/**
+ * @brief Writes the capability TLVs of a configuration.
+ *
+ * @param config Values to advertise.
+ * @param out Output buffer (at least MAX_CAPABILITIES_SIZE bytes).
+ * @return The number of bytes written.
+ */
+int encodeCapabilities(const LinkConfig *config, unsigned char *out) {
+    int idx = 0;
+
+    out[idx++] = CAP_MAX_PAYLOAD;
+    out[idx++] = 4;
+    out[idx++] = (config->maxPayload >> 24) & 0xFF;
+    out[idx++] = (config->maxPayload >> 16) & 0xFF;
+    out[idx++] = (config->maxPayload >> 8) & 0xFF;
+    out[idx++] = config->maxPayload & 0xFF;
+
+    out[idx++] = CAP_ARQ_MODE;
+    out[idx++] = 1;
+    out[idx++] = config->arqMode;
+
+    out[idx++] = CAP_WINDOW;
+    out[idx++] = 1;
+    out[idx++] = config->windowSize;
+
+    out[idx++] = CAP_FCS;
+    out[idx++] = 1;
+    out[idx++] = config->fcsType;
+
+    out[idx++] = CAP_REPLY;
+    out[idx++] = 1;
+    out[idx++] = config->replyFrames;
+
+    out[idx++] = CAP_OFFSET_DATA;
+    out[idx++] = 1;
+    out[idx++] = config->offsetData;
+
+    return idx;
+}
+
+/**
+ * @brief Parses capability TLVs received in a SET or UA frame.
+ *
+ * @param data TLV list (already destuffed and checked).
+ * @param size Size of the list.
+ * @param config Updated with the values found.
+ * @return 0 on success, -1 if a TLV is truncated or a value is not valid.
+ */
+int decodeCapabilities(const unsigned char *data, int size, LinkConfig *config) {
+    int idx = 0;
+
+    while (idx + 2 <= size) {
+        unsigned char type = data[idx++];
+        unsigned char length = data[idx++];
+        const unsigned char *value = &data[idx];
+        if (idx + length > size) return -1;
+        idx += length;
+
+        switch (type) {
+            case CAP_MAX_PAYLOAD: {
+                if (length != 4) return -1;
+                long payload = ((long)value[0] << 24) | (value[1] << 16) | (value[2] << 8) | value[3];
+                if (payload < MIN_LINK_PAYLOAD_SIZE || payload > MAX_LINK_PAYLOAD_SIZE) return -1;
+                config->maxPayload = payload;
+                break;
+            }
+            case CAP_ARQ_MODE:
+                if (length != 1 || value[0] > ARQ_SELECTIVE_REPEAT) return -1;
+                config->arqMode = value[0];
+                break;
+            case CAP_WINDOW:
+                if (length != 1 || value[0] < 1 || value[0] > MAX_WINDOW_SIZE) return -1;
+                config->windowSize = value[0];
+                break;
+            case CAP_FCS:
+                if (length != 1 || value[0] > FCS_CRC32C) return -1;
+                config->fcsType = value[0];
+                break;
+            case CAP_REPLY:
+                if (length != 1 || value[0] > 1) return -1;
+                config->replyFrames = value[0];
+                break;
+            case CAP_OFFSET_DATA:
+                if (length != 1 || value[0] > 1) return -1;
+                config->offsetData = value[0];
+                break;
+            default:
+                // Capability from a newer version: ignored
+                break;
+        }
+    }
+
+    return (idx == size) ? 0 : -1;
+}
+
+/**
+ * @brief Computes the configuration both ends can use.
+ *
+ * The receiver applies it to the proposal in SET and answers with the result in
+ * UA; the transmitter applies it again to that answer, which yields the same values.
+ */
+void negotiateLinkConfig(const LinkConfig *local, const LinkConfig *peer, LinkConfig *agreed) {
+    agreed->arqMode = (local->arqMode < peer->arqMode) ? local->arqMode : peer->arqMode;
+    agreed->fcsType = (local->fcsType > peer->fcsType) ? local->fcsType : peer->fcsType;
+    agreed->maxPayload = (local->maxPayload < peer->maxPayload) ? local->maxPayload : peer->maxPayload;
+    agreed->windowSize = (local->windowSize < peer->windowSize) ? local->windowSize : peer->windowSize;
+    agreed->replyFrames = local->replyFrames && peer->replyFrames;
+    agreed->offsetData = local->offsetData && peer->offsetData;
+
+    if (agreed->arqMode == ARQ_STOP_AND_WAIT) {
+        agreed->windowSize = 1;
+    } else if (agreed->arqMode == ARQ_SELECTIVE_REPEAT && agreed->windowSize > MAX_SR_WINDOW_SIZE) {
+        agreed->windowSize = MAX_SR_WINDOW_SIZE;
+    }
+}
+
+const char *arqModeName(ArqMode mode) {
+    switch (mode) {
+        case ARQ_GO_BACK_N:        return "gbn";
+        case ARQ_SELECTIVE_REPEAT: return "sr";
+        default:                   return "saw";
+    }
+}
@@ -0,0 +1,88 @@
+// Link layer runtime configuration.
+// Kept apart from link_layer.h, which must not be changed.
+// Each end loads its own values from the environment; llopen then agrees on
+// the values used by both through the capability TLVs carried by SET and UA.
+
+#ifndef _LINK_CONFIG_H_
+#define _LINK_CONFIG_H_
+
+#include "fcs.h"
+#include <stdbool.h>
+
+// ARQ strategy used for I-frames
+typedef enum
+{
+    ARQ_STOP_AND_WAIT,
+    ARQ_GO_BACK_N,
+    ARQ_SELECTIVE_REPEAT,
+} ArqMode;
+
+typedef struct
+{
+    ArqMode arqMode;
+    int windowSize;
+    FcsType fcsType;   // Trailer of I-frames (BCC2 or a CRC)
+    int maxPayload;    // Largest payload of an I-frame (bytes)
+    bool replyFrames;  // The receiver may answer with a reply frame (see llreply)
+    bool offsetData;   // Data packets carry their file offset (C_DATA_AT, see packet_types.h)
+} LinkConfig;
+
+// Sequence number space carried in the C field of I/RR/REJ frames.
+// Stop-and-Wait uses bit 7 (modulo 2), sliding window modes use bits 4-7 (modulo 16).
+#define SEQ_MODULUS_SAW    2
+#define SEQ_MODULUS_WINDOW 16
+
+// Go-Back-N needs windowSize < modulus, Selective Repeat windowSize <= modulus / 2
+#define DEFAULT_WINDOW_SIZE 7
+#define MAX_WINDOW_SIZE     (SEQ_MODULUS_WINDOW - 1)
+#define MAX_SR_WINDOW_SIZE  (SEQ_MODULUS_WINDOW / 2)
+
+// Payload limits. Data packets carry their length in 16 bits, hence the upper bound;
+// the lower one leaves room for the START/END control packets.
+#define MIN_LINK_PAYLOAD_SIZE 64
+#define MAX_LINK_PAYLOAD_SIZE 65536
+
+// Capability TLVs (type, length, value) in the information field of SET and UA.
+// SET carries the transmitter's proposal, UA the values agreed by the receiver.
+// The TLV list is stuffed and protected by a CRC-16 (see fcs.h); unknown types
+// are skipped.
+#define CAP_MAX_PAYLOAD 0x01   // 4 bytes, most significant first
+#define CAP_ARQ_MODE    0x02   // 1 byte, ArqMode
+#define CAP_WINDOW      0x03   // 1 byte
+#define CAP_FCS         0x04   // 1 byte, FcsType
+#define CAP_REPLY       0x05   // 1 byte, 1 if reply frames are supported
+#define CAP_OFFSET_DATA 0x06   // 1 byte, 1 if offset-addressed data packets are supported
+#define MAX_CAPABILITIES_SIZE 32
+
+// Global configuration, filled by loadLinkConfig() and replaced in llopen
+// by the negotiated values
+extern LinkConfig linkConfig;
+
+// What a peer that sends SET/UA without capabilities supports
+extern const LinkConfig legacyLinkConfig;
+
+// Load the configuration from the environment, falling back to the defaults.
+//   LL_ARQ    : "saw" (default), "gbn" or "sr"
+//   LL_WINDOW : window size for the sliding window modes
+//               (1..MAX_WINDOW_SIZE, 1..MAX_SR_WINDOW_SIZE for Selective Repeat)
+//   LL_FCS    : "xor" (default, 1-byte BCC2), "crc16" or "crc32c"
+//   LL_PAYLOAD: maximum I-frame payload (MIN_LINK_PAYLOAD_SIZE..MAX_LINK_PAYLOAD_SIZE,
+//               default MAX_PAYLOAD_SIZE)
+void loadLinkConfig();
+
+// Write the capability TLVs describing config. Returns the number of bytes.
+int encodeCapabilities(const LinkConfig *config, unsigned char *out);
+
+// Read capability TLVs into *config; values not present are left unchanged.
+// Returns 0 on success or -1 if the list is malformed or a value is out of range.
+int decodeCapabilities(const unsigned char *data, int size, LinkConfig *config);
+
+// Values both ends can use: the smaller payload, window and ARQ mode
+// (Stop-and-Wait < Go-Back-N < Selective Repeat), the stronger FCS, and
+// reply frames and offset-addressed data only if both support them.
+void negotiateLinkConfig(const LinkConfig *local, const LinkConfig *peer, LinkConfig *agreed);
+
+// Name of an ARQ mode ("saw", "gbn", "sr").
+const char *arqModeName(ArqMode mode);
+
+#endif // _LINK_CONFIG_H_
@@ -1,834 +1,1554 @@
-// Link layer protocol implementation
-
-#include "link_layer.h"
-#include "serial_port.h"
-#include "stdbool.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include "alarm_sigaction.h"
-#include "statistics.h"
-
-
-#define SUFrame_SIZE 5
-#define I_HEADER_SIZE 4
-
-// S/U Frame
-#define FLAG 0x7E
-#define A_TX 0x03
-#define A_RX 0x01
-
-// Control field values (C)
-#define C_SET  0x03
-#define C_UA   0x07
-#define C_DISC 0x0B
-#define C_RR0  0x05
-#define C_RR1  0x85
-#define C_REJ0 0x01
-#define C_REJ1 0x81
-
-// I-Frame Control Field (C) Values
-#define C_I0 0x00
-#define C_I1 0x80
-
-// Escape byte for byte stuffing
-#define ESC 0x7D
-
-// Global variables
-int Ns = 0;
-int Nr = 0;
-extern int fd;
-extern int alarmEnabled;
-extern int alarmCount;
-
-// Global variables of the connection and roles
-static LinkLayerRole globalRole;
-static int globalTimeout;
-static int globalNRetransmissions;
-
-// =================================================================
-// State Machine for Frame Reception
-// =================================================================
-
-/*
- * State machine used for receiving both S/U Frames (F|A|C|BCC1|F) and I-Frames (F|A|C|BCC1|DATA|BCC2|F).
- * - START, FLAG_RCV, A_RCV, C_RCV verify the header structure.
- * - BCC1_OK confirms the BCC1 validity and then handles the reception of the variable-length payload (DATA + BCC2)
- *   up to the closing FLAG.
- */
-enum State{START, FLAG_RCV, A_RCV, C_RCV, BCC1_OK, STOP};
-
-
-// =================================================================
-// FRAME CONSTRUCTION FUNCTIONS
-// =================================================================
-
-/**
- * @brief Builds a 5-byte Supervisory (S) or Unnumbered (U) frame.
- *
- * Frame structure: F | A | C | BCC1 | F
- * BCC1 is calculated as A XOR C.
- *
- * @param frame Pointer to the buffer where the 5-byte frame will be stored.
- * @param address The Address field (A_TX or A_RX).
- * @param control The Control field (e.g., C_SET, C_UA, C_DISC, C_RRx, C_REJx).
- */
-void buildSUFrame(unsigned char *frame, unsigned char address, unsigned char control)
-{
-    frame[0] = FLAG;
-    frame[1] = address;
-    frame[2] = control;
-    frame[3] = address ^ control;
-    frame[4] = FLAG;
-}
-
-/**
- * @brief Builds an Information (I) frame, including byte stuffing.
- *
- * Frame structure: F | A | C | BCC1 | Data (stuffed) | BCC2 (stuffed) | F
- * C field is set based on the current sequence number Ns (C_I0 or C_I1).
- *
- * @param frame Pointer to the output buffer (must be large enough for stuffing).
- * @param data Pointer to the raw application layer payload.
- * @param dataSize Size of the raw payload.
- * @return The total size of the constructed I-frame, or -1 on failure.
- */
-
-int buildIFrame(unsigned char *frame, const unsigned char *data, int dataSize)
-{
-    int idx = 0;
-    unsigned char C_Field = (Ns == 0) ? C_I0 : C_I1;
-    
-    // Header
-    frame[idx++] = FLAG;
-    frame[idx++] = A_TX;
-    frame[idx++] = C_Field;
-    frame[idx++] = A_TX ^ C_Field;
-    
-    // Overflow Inspection
-    if (dataSize > MAX_PAYLOAD_SIZE) return -1;
-
-    // Calculate BCC2
-    unsigned char bcc2 = 0;
-    for (int i = 0; i < dataSize; i++) {
-        bcc2 ^= data[i];
-    }
-
-    // Byte stuffing on payload + BCC2
-    unsigned char tempBuffer[MAX_PAYLOAD_SIZE + 1];
-    memcpy(tempBuffer, data, dataSize);
-    tempBuffer[dataSize] = bcc2;
-    
-    for (int i = 0; i < dataSize + 1; i++) {
-        if (tempBuffer[i] == FLAG || tempBuffer[i] == ESC) {
-            frame[idx++] = ESC;
-            frame[idx++] = tempBuffer[i] ^ 0x20;
-        } else {
-            frame[idx++] = tempBuffer[i];
-        }
-    }
-    
-    frame[idx++] = FLAG;
-    
-    return idx;
-}
-
-// =================================================================
-// SERIAL PORT WRITE WITH ALARM/RETRANSMISSION
-// =================================================================
-
-/**
- * @brief Writes a frame to the serial port and sets the retransmission alarm.
- *
- * This function only sends the frame if the alarm is not already enabled (i.e.,
- * if we're not waiting for an acknowledgment).
- *
- * @param frame The frame to send.
- * @param frameSize The size of the frame.
- * @param timeout The timeout value in seconds.
- * @param nRetransmissions Pointer to the retransmission counter (decremented externally upon timeout).
- * @return 0 on success, -1 on fatal error (max retransmissions reached or write failure).
- */
-
-int writeToSerialPort(unsigned char *frame, int frameSize, int timeout, int *nRetransmissions)
-{
-    if (*nRetransmissions < 0) {
-        printf("ERROR: Maximum retransmissions reached.\n");
-        return -1;
-    }
-    
-    if (!alarmEnabled) {
-        int bytesWritten = writeBytesSerialPort(frame, frameSize);
-        if (bytesWritten != frameSize) {
-            fprintf(stderr, "Erro: falha ao escrever frame (%d/%d bytes)\n", bytesWritten, frameSize);
-            return -1;
-        }
-
-        /*
-        printf("Frame sent. Waiting for response... (retransmissions left: %d)\n", *nRetransmissions);
-        */
-
-        alarm(timeout);
-        alarmEnabled = TRUE;
-        return 0;
-    }
-    
-    return 0;
-}
-
-//===============================================
-// UTILITY FUNCTION
-//===============================================
-
-/**
- * @brief Calculates the Block Check Character (BCC2) by XORing all data bytes.
- *
- * @param data Pointer to the data payload.
- * @param dataSize Size of the data payload.
- * @return The calculated BCC2 byte.
- */
-unsigned char calculateBCC2(const unsigned char *data, int dataSize) {
-    unsigned char bcc2 = 0;
-    for (int i = 0; i < dataSize; i++) {
-        bcc2 ^= data[i];
-    }
-    return bcc2;
-}
-
-//===============================================
-// LLOPEN (Connection Setup)
-//===============================================
-
-/**
- * @brief Establishes the connection at the link layer.
- *
- * Implements the HDLC SABM/UA exchange (three-wire handshake).
- *
- * @param connectionParameters LinkLayer structure containing role, port, etc.
- * @return File descriptor (fd) on success, -1 on failure.
- */
-
-int llopen(LinkLayer connectionParameters)
-{
-    fd = openSerialPort(connectionParameters.serialPort, connectionParameters.baudRate);
-    if (fd < 0) {
-        perror("openSerialPort");
-        return -1;
-    }
-
-    globalRole = connectionParameters.role;
-    globalTimeout = connectionParameters.timeout;
-    globalNRetransmissions = connectionParameters.nRetransmissions;
-    
-    if (connectionParameters.role == LlTx) {
-        if (setupAlarm() < 0) {
-            perror("setupAlarm");
-            return -1;
-        }
-    }
-
-    if (connectionParameters.role == LlTx) {
-        printf("TX: Sending SET frame...\n");
-        
-        unsigned char setFrame[SUFrame_SIZE];
-        buildSUFrame(setFrame, A_TX, C_SET);
-        
-        int nRetransmissions = connectionParameters.nRetransmissions -1;
-        int timeout = connectionParameters.timeout;
-        
-        enum State state = START;
-        unsigned char byte;
-        
-        alarmEnabled = FALSE;
-        alarmCount = 0;
-        
-        while (nRetransmissions >= 0) {
-            writeToSerialPort(setFrame, SUFrame_SIZE, timeout, &nRetransmissions);
-            
-            state = START;
-            
-            while (state != STOP && alarmEnabled) {
-                if (readByteSerialPort(&byte) > 0) {
-                    switch(state) {
-                        case START:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            break;
-                        case FLAG_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == A_RX) state = A_RCV;
-                            else state = START;
-                            break;
-                        case A_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == C_UA) state = C_RCV;
-                            else state = START;
-                            break;
-                        case C_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == (A_RX ^ C_UA)) state = BCC1_OK;
-                            else state = START;
-                            break;
-                        case BCC1_OK:
-                            if (byte == FLAG) {
-                                state = STOP;
-                                alarm(0);
-                                alarmEnabled = FALSE;
-                                printf("TX: UA received. Connection established.\n");
-                                Ns = 0;
-                                printf(" \n fd do tx - >\"%d\" \n",fd);
-                                return fd;
-                            }
-                            else state = START;
-                            break;
-                        case STOP:
-                            break;
-                    }
-                }
-            }
-            
-            if (!alarmEnabled) {
-                nRetransmissions--;
-                printf("TX: Timeout or REJ! Retransmitting...\n");
-            }
-        }
-        
-        printf("TX: ERROR - Failed to establish connection after all retries.\n");
-        closeSerialPort();
-        return -1;
-        
-    } else {
-        printf("RX: Waiting for SET frame...\n");
-        
-        enum State state = START;
-        unsigned char byte;
-        
-        while (state != STOP) {
-            if (readByteSerialPort(&byte) > 0) {
-                switch(state) {
-                    case START:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        break;
-                    case FLAG_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == A_TX) state = A_RCV;
-                        else state = START;
-                        break;
-                    case A_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == C_SET) state = C_RCV;
-                        else state = START;
-                        break;
-                    case C_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == (A_TX ^ C_SET)) state = BCC1_OK;
-                        else state = START;
-                        break;
-                    case BCC1_OK:
-                        if (byte == FLAG) state = STOP;
-                        else state = START;
-                        break;
-                    case STOP:
-                        break;
-                }
-            }
-        }
-        
-        printf("RX: SET received. Sending UA...\n");
-        
-        unsigned char uaFrame[SUFrame_SIZE];
-        buildSUFrame(uaFrame, A_RX, C_UA);
-        
-        if (writeBytesSerialPort(uaFrame, SUFrame_SIZE) < 0) {
-            perror("writeBytesSerialPort - UA");
-            return -1;
-        }
-        
-        Nr = 0;
-        printf(" \n fd do rx - >\"%d\" \n",fd);
-        return fd;
-    }
-}
-
-//===============================================
-// LLWRITE (Data Transmission)
-//===============================================
-
-/**
- * @brief Transmits an Information (I) frame containing the application layer data.
- *
- * Implements Stop-and-Wait ARQ logic with retransmissions on timeout or REJ.
- *
- * @param buf Pointer to the raw application layer data payload.
- * @param bufSize Size of the payload.
- * @return The number of bytes successfully written (bufSize), or -1 on failure.
- */
-int llwrite(const unsigned char *buf, int bufSize)
-{
-    unsigned char frameTx[MAX_PAYLOAD_SIZE * 2 + 10];
-    int frameSize = buildIFrame(frameTx, buf, bufSize);
-    if (frameSize < 0) {
-        fprintf(stderr, "Erro: buildIFrame falhou\n");
-        return -1;
-    }
-    
-    stats.framesTransmitted++;
-
-    int nRetransmissions = globalNRetransmissions -1;
-    int timeout = globalTimeout;
-
-    enum State state = START;
-    unsigned char byte;
-    unsigned char expectedRR = (Ns == 0) ? C_RR1 : C_RR0;
-    unsigned char nexpectedRR = (Ns == 0) ? C_RR1 : C_RR0;
-    
-    alarmEnabled = FALSE;
-    alarmCount = 0;
-    
-    bool isREJ = false;
-    while (nRetransmissions >= 0) {
-        writeToSerialPort(frameTx, frameSize, timeout, &nRetransmissions);
-        printf("TX: I-Frame sent (Ns=%d). Waiting for RR... (retries left: %d)\n", Ns, nRetransmissions);
-        
-        state = START;
-        while (state != STOP && alarmEnabled) {
-            if (readByteSerialPort(&byte) > 0) {
-                switch(state) {
-                    case START:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        break;
-                    case FLAG_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == A_RX) state = A_RCV;
-                        else state = START;
-                        break;
-                    case A_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == expectedRR) {
-                            isREJ = FALSE;
-                            state = C_RCV;
-                        }
-                        else if (byte == nexpectedRR) {
-                            state = STOP;
-                            alarm(0);
-                            alarmEnabled = FALSE;
-                            printf("TX: RR received. Duplicated Frame acknowledged.\n");
-                            Ns = 1 - Ns;
-                            return bufSize;
-                        }
-                        else if (byte == C_REJ0 || byte == C_REJ1) {
-                            isREJ = TRUE;
-                            state = C_RCV;
-                        }
-                        else state = START;
-                        break;
-                    case C_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == (A_RX ^ expectedRR)) {
-                            state = BCC1_OK;
-                        }
-                        else state = START;
-                        break;
-                    case BCC1_OK:
-                        if (byte == FLAG) {
-                            state = STOP;
-                            alarm(0);
-                            alarmEnabled = FALSE;
-                            printf("TX: RR received. Frame acknowledged.\n");
-                            Ns = 1 - Ns;
-                            return bufSize;
-                        }
-                        else {
-                            if (isREJ) {
-                                printf("TX: Received REJ — retransmitting frame.\n");
-                                // force resending
-                                alarm(0);
-                                alarmEnabled = FALSE;
-                            }
-                            state = START;
-                        }
-                        break;
-                    case STOP:
-                        break;
-                }
-            }
-        }
-        
-        if (!alarmEnabled) {
-            nRetransmissions--;
-            if (isREJ) {
-                printf("TX: REJ received — retransmitting frame.\n");
-                stats.rejReceived++;
-                stats.framesRetransmitted++;
-            }
-            else {
-                printf("TX: Timeout — retransmitting frame.\n");
-                stats.timeouts++; 
-                stats.framesRetransmitted++; 
-            }
-            isREJ = FALSE;
-        }
-    }
-    
-    printf("TX: ERROR - Failed to send I-Frame after all retries.\n");
-    return -1;
-}
-
-//===============================================
-// LLREAD (Data Reception)
-//===============================================
-
-/**
- * @brief Reads an Information (I) frame from the serial port and extracts the payload.
- *
- * Implements a state machine to receive the frame, performs destuffing, and checks BCC2.
- * Sends RR upon success or REJ upon error/duplicate frame detection.
- *
- * @param packet Pointer to the buffer where the application layer payload will be stored.
- * @return The size of the extracted payload on success, or -1 on failure.
- */
-int llread(unsigned char *packet)
-{
-    enum State state = START;
-    unsigned char byte;
-
-    // Buffer to the payload (data) extracted into the I-Frame
-    unsigned char dataBuffer[MAX_PAYLOAD_SIZE * 2];
-    int dataIdx = 0;
-
-    // Control variables 
-    unsigned char expectedC = (Nr == 0) ? C_I0 : C_I1;
-    unsigned char currentC = 0;
-    int escaped = 0;
-    
-    while (state != STOP) {
-        int isSuccess = readByteSerialPort(&byte);
-        if (isSuccess > 0) {
-            switch(state) {
-                case START:
-                    if (byte == FLAG) state = FLAG_RCV;
-                    break;
-                case FLAG_RCV:
-                    if (byte == FLAG) state = FLAG_RCV;
-                    else if (byte == A_TX) state = A_RCV;
-                    else state = START;
-                    break;
-                case A_RCV:
-                    if (byte == FLAG) state = FLAG_RCV;
-                    else {
-                        currentC = byte;
-                        state = C_RCV;
-                    }
-                    break;
-                case C_RCV:
-                    if(byte == FLAG) {state = FLAG_RCV;}
-                    else if (byte == (A_TX ^ currentC)) {
-                        // Verification to see if its the awaited I-frame (C_I0 ou C_I1)
-                        if (currentC == 0x00 || currentC == 0x80) {
-                            if (currentC != expectedC) {
-                                stats.duplicateFrames++;
-                                // Duplicated Frame
-                                printf("RX: Duplicate frame detected (got %s, expected %s)\n",
-                                    currentC == 0x00 ? "I0" : "I1",
-                                    expectedC == 0x00 ? "I0" : "I1");
-                                
-                                // RR sent to confirm what is already expect
-                                unsigned char rrFrame[SUFrame_SIZE];
-                                unsigned char rrControl = (Nr == 0) ? C_RR1 : C_RR0;
-                                buildSUFrame(rrFrame, A_RX, rrControl);
-                                int bytesWritten = writeBytesSerialPort(rrFrame, SUFrame_SIZE);
-                                if (bytesWritten != SUFrame_SIZE) {
-                                    fprintf(stderr, "Erro: falha ao escrever frame (%d/%d bytes)\n", bytesWritten, SUFrame_SIZE);
-                                    return -1;
-                                }
-
-                                // Discard the duplicated Frame
-                                state = START;
-                                dataIdx = 0;
-                                break;
-                            }
-                            
-                            // Expected Frame
-                            state = BCC1_OK;
-                        } else {
-                            state = START;
-                        }
-                    }
-                    else {state = START;}
-                    break;
-                case BCC1_OK:
-                    if (byte == FLAG) {
-                        // If we recive a FLAG without data, BCC2 was not recived
-                        if (dataIdx == 0) {
-                            state = FLAG_RCV;
-                            break;
-                        }
-                        
-                        unsigned char receivedBCC2 = dataBuffer[dataIdx - 1];
-                        dataIdx--;
-                        
-                        unsigned char calculatedBCC2 = 0;
-                        for (int i = 0; i < dataIdx; i++) {
-                            calculatedBCC2 ^= dataBuffer[i];
-                        }
-                        
-                        if (receivedBCC2 == calculatedBCC2) {
-                            stats.framesReceivedCorrectly++;
-                            // Valid data
-                            memcpy(packet, dataBuffer, dataIdx);
-                            
-                            unsigned char rrFrame[SUFrame_SIZE];
-                            unsigned char rrControl = (Nr == 0) ? C_RR1 : C_RR0;
-                            
-                            buildSUFrame(rrFrame, A_RX, rrControl);
-                            int bytesWritten = writeBytesSerialPort(rrFrame, SUFrame_SIZE);
-                            if (bytesWritten != SUFrame_SIZE) {
-                                fprintf(stderr, "Erro: falha ao escrever frame (%d/%d bytes)\n", bytesWritten, SUFrame_SIZE);
-                                return -1;
-                            }
-                            
-                            printf("RX: I-Frame received (Nr=%d). Sent RR%d.\n", Nr, 1 - Nr);
-                            Nr = (Nr == 0) ? 1:0;
-                            return dataIdx;
-                        } else {
-                            stats.bcc2Errors++;
-                            stats.rejSent++;
-                            unsigned char rejFrame[SUFrame_SIZE];
-                            unsigned char rejControl = (Nr == 0) ? C_REJ0 : C_REJ1;
-                            buildSUFrame(rejFrame, A_RX, rejControl);
-                            int bytesWritten = writeBytesSerialPort(rejFrame, SUFrame_SIZE);
-                            if (bytesWritten != SUFrame_SIZE) {
-                                fprintf(stderr, "Erro: falha ao escrever frame (%d/%d bytes)\n", bytesWritten, SUFrame_SIZE);
-                                return -1;
-                            }
-                            
-                            printf("RX: Frame error. Sent REJ%d.\n", Nr);
-                            
-                            dataIdx = 0;
-                            escaped = 0;
-                            state = START;
-                        }
-                    }
-                    else if (byte == ESC) {
-                        escaped = 1;
-                    }
-                    else {
-                        if (escaped) {
-                            dataBuffer[dataIdx++] = byte ^ 0x20;
-                            escaped = 0;
-                        } else {
-
-                            if (dataIdx < MAX_PAYLOAD_SIZE * 2) {
-                                dataBuffer[dataIdx++] = byte;
-                            } else {
-                                // Buffer overflow, Frame discarded
-                                printf("RX: Data buffer overflow. Restarting.\n");
-                                dataIdx = 0;
-                                escaped = 0;
-                                state = START;
-                            }
-                        }
-                    }
-                    break;
-                case STOP:
-                    break;
-            }
-        }
-    }
-    return -1;
-}
-
-//===============================================
-// LLCLOSE (Connection Teardown)
-//===============================================
-
-/**
- * @brief Closes the connection at the link layer.
- *
- * Implements the HDLC DISC/DISC/UA exchange.
- *
- * @return 0 on successful closure, -1 on failure.
- */
-int llclose()
-{
-    if( globalRole == LlTx ){
-        printf("Tx: Preparing to send Disc ( SU Frame) to RX\n");
-        unsigned char discFrame[SUFrame_SIZE];
-        buildSUFrame(discFrame, A_TX, C_DISC);
-
-        int nRetransmissions = globalNRetransmissions -1;
-        int timeout = globalTimeout;
-
-        enum State state = START;
-        unsigned char byte;
-
-        alarmEnabled = FALSE;
-        alarmCount = 0;
-        
-        while (nRetransmissions >= 0) {
-            writeToSerialPort(discFrame, SUFrame_SIZE, timeout, &nRetransmissions);
-            printf("Tx: Disc ( SU Frame ) Sent\n");
-            
-            state = START;
-            
-            while (state != STOP && alarmEnabled) {
-                if (readByteSerialPort(&byte) > 0) {
-                    switch(state) {
-                        case START:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            break;
-                        case FLAG_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == A_RX) state = A_RCV;
-                            else state = START;
-                            break;
-                        case A_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == C_DISC) state = C_RCV;
-                            else state = START;
-                            break;
-                        case C_RCV:
-                            if (byte == FLAG) state = FLAG_RCV;
-                            else if (byte == (A_RX ^ C_DISC)) state = BCC1_OK;
-                            else state = START;
-                            break;
-                        case BCC1_OK:
-                            if (byte == FLAG) {
-                                state = STOP;
-                                alarm(0);
-                                alarmEnabled = FALSE;
-                                printf("TX: Disc received from RX.\n");
-
-                                printf("TX: Preparring UA ( SU frame ) to finish the connection.\n");
-
-                                unsigned char UAFrame[SUFrame_SIZE];
-                                buildSUFrame( UAFrame, A_TX, C_UA);
-                                writeBytesSerialPort( UAFrame, SUFrame_SIZE);
-                                
-                                int isClosed = closeSerialPort();
-                                if (isClosed == 0){
-                                    printf("Tx: Connection terminated\n");
-                                }
-                                else{
-                                    perror("Error closing SerialPort on Tx");
-                                    return -1;
-                                }
-
-                                return 0;
-                            }
-                            else state = START;
-                            break;
-                        case STOP:
-                            break;
-                    }
-                }
-            }
-            
-            if (!alarmEnabled) {
-                nRetransmissions--;
-                printf("TX: Timeout or REJ! Retransmitting...\n");
-            }
-        }
-        
-        printf("TX: ERROR - Failed to establish connection after all retries.\n");
-        closeSerialPort();
-        return -1;
-        
-    }
-    else{
-        printf("RX: Waiting for DISC frame...\n");
-        
-        enum State state = START;
-        unsigned char byte;
-        
-        while (state != STOP) {
-            if (readByteSerialPort(&byte) > 0) {
-                switch(state) {
-                    case START:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        break;
-                    case FLAG_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == A_TX) state = A_RCV;
-                        else state = START;
-                        break;
-                    case A_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == C_DISC) state = C_RCV;
-                        else state = START;
-                        break;
-                    case C_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == (A_TX ^ C_DISC)) state = BCC1_OK;
-                        else state = START;
-                        break;
-                    case BCC1_OK:
-                        if (byte == FLAG) state = STOP;
-                        else state = START;
-                        break;
-                    case STOP:
-                        break;
-                }
-            }
-        }
-        
-        printf("RX: DISC received. Sending DISC...\n");
-        
-        unsigned char discFrame[SUFrame_SIZE];
-        buildSUFrame(discFrame, A_RX, C_DISC);
-        
-        if (writeBytesSerialPort(discFrame, SUFrame_SIZE) < 0) {
-            perror("writeBytesSerialPort - UA");
-            return -1;
-        }
-
-        printf("RX: Waiting for UA frame...\n");
-        
-        state = START;
-        
-        while (state != STOP) {
-            if (readByteSerialPort(&byte) > 0) {
-                switch(state) {
-                    case START:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        break;
-                    case FLAG_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == A_TX) state = A_RCV;
-                        else state = START;
-                        break;
-                    case A_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == C_UA) state = C_RCV;
-                        else state = START;
-                        break;
-                    case C_RCV:
-                        if (byte == FLAG) state = FLAG_RCV;
-                        else if (byte == (A_TX ^ C_UA)) state = BCC1_OK;
-                        else state = START;
-                        break;
-                    case BCC1_OK:
-                        if (byte == FLAG) state = STOP;
-                        else state = START;
-                        break;
-                    case STOP:
-                        break;
-                }
-            }
-        }
-
-        printf("RX: UA received. Terminating the connection...\n");
-
-        int isClosed = closeSerialPort();
-        if (isClosed == 0){
-            printf("RX: Connection terminated\n");
-        }
-        else{
-            perror("Error closing SerialPort on Tx");
-            return -1;
-        }
-
-        return 0;
-    }
-
-}
\ No newline at end of file
+// Link layer protocol implementation
+
+#include "link_layer.h"
+#include "link_layer_ext.h"
+#include "serial_port.h"
+#include "stdbool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "frame_reader.h"
+#include "byte_stuffing.h"
+#include "statistics.h"
+#include "link_config.h"
+#include "fcs.h"
+#include "rtt_estimator.h"
+#include "event_loop.h"
+#include "trace.h"
+#include "stats_export.h"
+#include "profiler.h"
+#include "stats_shm.h"
+
+
+#define SUFrame_SIZE 5
+#define I_HEADER_SIZE 4
+
+// S/U Frame
+#define FLAG 0x7E
+#define A_TX 0x03
+#define A_RX 0x01
+
+// Control field values (C)
+#define C_SET  0x03
+#define C_UA   0x07
+#define C_DISC 0x0B
+#define C_RR0  0x05
+#define C_RR1  0x85
+#define C_REJ0 0x01
+#define C_REJ1 0x81
+
+// I-Frame Control Field (C) Values
+#define C_I0 0x00
+#define C_I1 0x80
+
+// The low nibble of C identifies I/RR/REJ frames, the high bits carry the sequence number
+#define C_TYPE_MASK 0x0F
+#define C_TYPE_I    0x00
+#define C_TYPE_RR   0x05
+#define C_TYPE_REJ  0x01
+#define C_TYPE_SREJ 0x0D
+
+// Largest I-frame for a payload size: header, every payload/FCS byte stuffed, closing flag
+#define IFRAME_CAPACITY(payload) (((payload) + FCS_MAX_SIZE) * 2 + I_HEADER_SIZE + 1)
+
+// Largest SET/UA frame: header, capability TLVs and their CRC-16 stuffed, closing flag
+#define MAX_UFRAME_SIZE ((MAX_CAPABILITIES_SIZE + 2) * 2 + I_HEADER_SIZE + 1)
+
+// Escape byte for byte stuffing
+#define ESC 0x7D
+
+// Bits on the line per byte (start bit, 8 data bits, stop bit)
+#define BITS_PER_BYTE 10
+
+// Global variables
+int Ns = 0; // Sequence number of the next I-frame to send
+int Nr = 0; // Sequence number of the next I-frame expected
+extern int fd;
+
+// Global variables of the connection and roles
+static LinkLayerRole globalRole;
+static int globalTimeout;
+static int globalNRetransmissions;
+static int globalBaudRate;
+
+// Time (currentTimeMs) at which the last byte written will have left the serial
+// line, estimated from the baud rate. RTT samples are measured from this instant,
+// so they do not depend on the frame size or on the frames queued ahead of it.
+static double lineFreeAt = 0;
+
+// Every wait of the link goes through this loop: the serial port is watched
+// for input and retransmissionTimer covers SET, DISC and the I-frame window
+static EventLoop linkLoop = {.epollFd = -1};
+static int retransmissionTimer = -1;
+
+// Wakes the loop every LL_STATS_INTERVAL ms to sample the statistics (-1 if unused)
+static int sampleTimer = -1;
+
+// Sequence number space in use (SEQ_MODULUS_SAW or SEQ_MODULUS_WINDOW)
+static int seqModulus = SEQ_MODULUS_SAW;
+
+// =================================================================
+// Transmitter window (retransmission buffer)
+// =================================================================
+
+/*
+ * Frames that were sent but not yet acknowledged are kept already stuffed, so a
+ * retransmission is a single write. The slots form a ring: the frame with sequence
+ * number txBase is in slot txHead, the next one in (txHead + 1) % windowSize, etc.
+ * Stop-and-Wait is the particular case windowSize = 1 with modulo 2 numbering.
+ */
+typedef struct {
+    unsigned char *frame;
+    int size;
+    int retriesLeft;   // Retransmissions left for this frame
+    double sentAt;     // When the first copy was handed to the serial port (ack latency)
+    double doneAt;     // When the last copy sent finishes leaving the line
+    bool retransmitted; // Not used for RTT samples (Karn's rule)
+} TxSlot;
+
+static TxSlot *txWindow = NULL;
+static int txBase = 0;         // Sequence number of the oldest unacknowledged frame
+static int txHead = 0;         // Slot holding txBase
+static int txOutstanding = 0;  // Frames sent and not yet acknowledged
+
+// =================================================================
+// Receiver reorder buffer (Selective Repeat)
+// =================================================================
+
+/*
+ * Frames that arrive ahead of Nr are kept until the missing ones are retransmitted.
+ * Slots are indexed by sequence number. Frames in [rxDeliver, Nr) are complete and
+ * waiting to be handed to the application, one per llread call; frames after Nr are
+ * the out-of-order ones. Both ranges together never span more than the modulus.
+ */
+typedef struct {
+    unsigned char *data;
+    int size;
+    bool valid;      // Holds a frame not yet handed to the application
+    bool srejSent;   // A SREJ for this sequence number is pending
+} RxSlot;
+
+static RxSlot *rxWindow = NULL;
+static int rxDeliver = 0;      // Sequence number of the next frame to hand to the application
+
+// Destuffed data field (payload + FCS) of the I-frame being checked by llread
+static unsigned char *rxDataBuffer = NULL;
+
+// UA sent by the receiver in llopen, sent again if the SET is repeated
+static unsigned char uaFrame[MAX_UFRAME_SIZE];
+static int uaFrameSize = 0;
+
+// =================================================================
+// Frame Reception
+// =================================================================
+
+/*
+ * Frames are delimited by the receive engine (frame_reader.c), which hands over the
+ * body between the flags: A | C | BCC1 for S/U Frames, A | C | BCC1 | DATA | FCS for
+ * I-Frames (DATA and FCS still stuffed; the FCS is BCC2 or a CRC, see fcs.h). The functions below validate those bodies.
+ */
+#define FRAME_HEADER_SIZE 3
+
+/**
+ * @brief Checks whether a frame body has a valid header sent by "address".
+ *
+ * @param body Frame body returned by readFrame.
+ * @param size Size of the body.
+ * @param address Expected Address field (A_TX or A_RX).
+ * @return TRUE if A matches and BCC1 == A ^ C.
+ */
+static bool isValidHeader(const unsigned char *body, int size, unsigned char address)
+{
+    return size >= FRAME_HEADER_SIZE && body[0] == address && body[2] == (body[0] ^ body[1]);
+}
+
+/**
+ * @brief Checks whether a frame body is the S/U frame F | address | control | BCC1 | F.
+ */
+static bool isSUFrame(const unsigned char *body, int size, unsigned char address, unsigned char control)
+{
+    return size == FRAME_HEADER_SIZE && isValidHeader(body, size, address) && body[1] == control;
+}
+
+/**
+ * @brief Checks whether a frame body is a U frame, with or without an information field
+ * (SET and UA may carry capabilities).
+ */
+static bool isUFrame(const unsigned char *body, int size, unsigned char address, unsigned char control)
+{
+    return isValidHeader(body, size, address) && body[1] == control;
+}
+
+/**
+ * @brief Reverts the byte stuffing of an I-frame data field.
+ *
+ * Runs without an escape are located with memchr and copied as one block.
+ *
+ * @param dst Output buffer.
+ * @param src Stuffed bytes (DATA + FCS).
+ * @param size Number of stuffed bytes.
+ * @param maxSize Capacity of dst.
+ * @return Number of bytes written to dst, or -1 if they do not fit or the field ends in ESC.
+ */
+static int destuff(unsigned char *dst, const unsigned char *src, int size, int maxSize)
+{
+    int out = 0;
+    const unsigned char *end = src + size;
+
+    while (src < end) {
+        const unsigned char *esc = memchr(src, ESC, end - src);
+        int run = (esc != NULL) ? esc - src : end - src;
+
+        if (out + run > maxSize) return -1;
+        memcpy(dst + out, src, run);
+        out += run;
+        if (esc == NULL) break;
+
+        if (esc + 1 == end || out == maxSize) return -1;
+        dst[out++] = esc[1] ^ 0x20;
+        src = esc + 2;
+    }
+    return out;
+}
+
+// readPayload results other than a size
+#define PAYLOAD_INVALID   -1
+#define PAYLOAD_FCS_ERROR -2
+
+/**
+ * @brief Extracts the data field of a frame body and checks its FCS.
+ *
+ * @param body Frame body (A | C | BCC1 | stuffed data and FCS).
+ * @param size Size of the body.
+ * @param data Receives the data followed by the FCS (maxData + FCS_MAX_SIZE bytes).
+ * @param maxData Largest data field accepted.
+ * @return The data size, PAYLOAD_INVALID if the field is too long or an escape is
+ *         broken, or PAYLOAD_FCS_ERROR if the FCS does not match.
+ */
+static int readPayload(const unsigned char *body, int size, unsigned char *data, int maxData)
+{
+    int trailerSize = fcsSize(linkConfig.fcsType);
+    int dataSize = destuff(data, body + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE, maxData + FCS_MAX_SIZE);
+    if (dataSize < trailerSize) return PAYLOAD_INVALID;
+
+    // The last bytes are the FCS
+    unsigned char fcs[FCS_MAX_SIZE];
+    dataSize -= trailerSize;
+    computeFcs(linkConfig.fcsType, data, dataSize, fcs);
+    if (memcmp(data + dataSize, fcs, trailerSize) != 0) return PAYLOAD_FCS_ERROR;
+    return dataSize;
+}
+
+/**
+ * @brief Reads the capabilities carried by a SET or UA frame.
+ *
+ * A frame without an information field comes from a peer that does not negotiate
+ * and only works with legacyLinkConfig.
+ *
+ * @param body Frame body returned by readFrame.
+ * @param size Size of the body.
+ * @param config Receives the capabilities.
+ * @return 0 on success, 1 if the peer does not negotiate (config is set to
+ *         legacyLinkConfig), -1 if the information field is corrupted or malformed.
+ */
+static int parseCapabilities(const unsigned char *body, int size, LinkConfig *config)
+{
+    *config = legacyLinkConfig;
+    if (size == FRAME_HEADER_SIZE) return 1;
+
+    unsigned char field[MAX_CAPABILITIES_SIZE + 2];
+    int fieldSize = destuff(field, body + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE, sizeof(field));
+    if (fieldSize < 2) return -1;
+
+    unsigned char crc[FCS_MAX_SIZE];
+    computeFcs(FCS_CRC16, field, fieldSize - 2, crc);
+    if (memcmp(field + fieldSize - 2, crc, 2) != 0) return -1;
+
+    return decodeCapabilities(field, fieldSize - 2, config);
+}
+
+//===============================================
+// SEQUENCE NUMBERS
+//===============================================
+
+/**
+ * @brief Encodes a sequence number in the bits of the C field reserved for it.
+ *
+ * @param seq Sequence number (0 .. seqModulus - 1).
+ * @return The C field bits (to be OR'ed with the frame type).
+ */
+static unsigned char seqToControl(int seq)
+{
+    return (seqModulus == SEQ_MODULUS_SAW) ? (seq << 7) : (seq << 4);
+}
+
+/**
+ * @brief Extracts the sequence number carried in a C field.
+ */
+static int controlToSeq(unsigned char control)
+{
+    return (seqModulus == SEQ_MODULUS_SAW) ? (control >> 7) : (control >> 4);
+}
+
+/**
+ * @brief Checks whether a C field belongs to an I-frame in the current numbering.
+ */
+static bool isIFrameControl(unsigned char control)
+{
+    if (seqModulus == SEQ_MODULUS_SAW) return control == C_I0 || control == C_I1;
+    return (control & C_TYPE_MASK) == C_TYPE_I;
+}
+
+/**
+ * @brief Distance from "from" to "to" in the sequence number space.
+ */
+static int seqDistance(int from, int to)
+{
+    return (to - from + seqModulus) % seqModulus;
+}
+
+
+// =================================================================
+// FRAME CONSTRUCTION FUNCTIONS
+// =================================================================
+
+/**
+ * @brief Builds a 5-byte Supervisory (S) or Unnumbered (U) frame.
+ *
+ * Frame structure: F | A | C | BCC1 | F
+ * BCC1 is calculated as A XOR C.
+ *
+ * @param frame Pointer to the buffer where the 5-byte frame will be stored.
+ * @param address The Address field (A_TX or A_RX).
+ * @param control The Control field (e.g., C_SET, C_UA, C_DISC, C_RRx, C_REJx).
+ */
+void buildSUFrame(unsigned char *frame, unsigned char address, unsigned char control)
+{
+    frame[0] = FLAG;
+    frame[1] = address;
+    frame[2] = control;
+    frame[3] = address ^ control;
+    frame[4] = FLAG;
+}
+
+/**
+ * @brief Builds a SET or UA frame that carries capability TLVs.
+ *
+ * Frame structure: F | A | C | BCC1 | TLVs (stuffed) | CRC-16 (stuffed) | F
+ *
+ * @param frame Output buffer (at least MAX_UFRAME_SIZE bytes).
+ * @param address The Address field.
+ * @param control C_SET or C_UA.
+ * @param config Capabilities to advertise.
+ * @return The total size of the frame.
+ */
+static int buildCapabilitiesFrame(unsigned char *frame, unsigned char address, unsigned char control,
+                                  const LinkConfig *config)
+{
+    unsigned char field[MAX_CAPABILITIES_SIZE + 2];
+    int fieldSize = encodeCapabilities(config, field);
+    computeFcs(FCS_CRC16, field, fieldSize, field + fieldSize);
+    fieldSize += 2;
+
+    int idx = 0;
+    frame[idx++] = FLAG;
+    frame[idx++] = address;
+    frame[idx++] = control;
+    frame[idx++] = address ^ control;
+    idx += stuffBytes(&frame[idx], field, fieldSize, NULL);
+    frame[idx++] = FLAG;
+    return idx;
+}
+
+/**
+ * @brief Builds a frame with an information field: an I-frame (see buildIFrame)
+ * or a reply frame from the receiver (see llreply).
+ *
+ * @param address A_TX for I-frames, A_RX for replies.
+ * @param control C field.
+ * @return The total size of the constructed frame, or -1 on failure.
+ */
+static int buildInfoFrame(unsigned char *frame, unsigned char address, unsigned char control,
+                          const struct iovec *iov, int iovcnt)
+{
+    int idx = 0;
+    unsigned char C_Field = control;
+    
+    // Overflow Inspection
+    size_t dataSize = 0;
+    for (int i = 0; i < iovcnt; i++) dataSize += iov[i].iov_len;
+    if (dataSize > (size_t)linkConfig.maxPayload) return -1;
+
+    // Header
+    frame[idx++] = FLAG;
+    frame[idx++] = address;
+    frame[idx++] = C_Field;
+    frame[idx++] = address ^ C_Field;
+
+    // Byte stuffing on payload + FCS
+    unsigned char fcs[FCS_MAX_SIZE] = {0};
+    if (linkConfig.fcsType == FCS_XOR) {
+        for (int i = 0; i < iovcnt; i++) {
+            idx += stuffBytes(&frame[idx], iov[i].iov_base, iov[i].iov_len, &fcs[0]);
+        }
+    } else {
+        FcsState state;
+        initFcs(&state, linkConfig.fcsType);
+        for (int i = 0; i < iovcnt; i++) {
+            idx += stuffBytes(&frame[idx], iov[i].iov_base, iov[i].iov_len, NULL);
+            updateFcs(&state, iov[i].iov_base, iov[i].iov_len);
+        }
+        finishFcs(&state, fcs);
+    }
+    idx += stuffBytes(&frame[idx], fcs, fcsSize(linkConfig.fcsType), NULL);
+    
+    frame[idx++] = FLAG;
+    
+    return idx;
+}
+
+/**
+ * @brief Builds an Information (I) frame, including byte stuffing.
+ *
+ * Frame structure: F | A | C | BCC1 | Data (stuffed) | FCS (stuffed) | F
+ * C field is set based on the current sequence number Ns (C_I0 or C_I1 in Stop-and-Wait).
+ * The payload blocks are stuffed straight into the frame, one after the other. With the
+ * XOR FCS the same pass also computes BCC2 (see byte_stuffing.c); a CRC is run over
+ * each raw block as it is stuffed.
+ *
+ * @param frame Pointer to the output buffer (must be large enough for stuffing).
+ * @param iov Blocks of the raw application layer payload.
+ * @param iovcnt Number of blocks.
+ * @return The total size of the constructed I-frame, or -1 on failure.
+ */
+
+int buildIFrame(unsigned char *frame, const struct iovec *iov, int iovcnt)
+{
+    return buildInfoFrame(frame, A_TX, C_TYPE_I | seqToControl(Ns), iov, iovcnt);
+}
+
+//===============================================
+// UTILITY FUNCTION
+//===============================================
+
+/**
+ * @brief Reads the next frame (readFrame), first sampling the statistics if it is time.
+ *
+ * Every wait of the link ends up here, and sampleTimer also ends waits, so the
+ * samples keep their interval through timeouts without another thread reading stats.
+ * The counters of the frames handled since the last call are published here too.
+ */
+static int readLinkFrame(const unsigned char **body, bool block)
+{
+    publishStatistics();
+    if (sampleTimer >= 0 && !timerPending(&linkLoop, sampleTimer)) {
+        sampleStatistics();
+        armTimer(&linkLoop, sampleTimer, statsSampleIntervalMs());
+    }
+    return readFrame(body, block);
+}
+
+/**
+ * @brief Adds the first copy of an I-frame to the line usage statistics, by category.
+ *
+ * @param frameSize Size of the stuffed frame.
+ * @param payloadSize Size of its payload before stuffing.
+ */
+static void countIFrameBytes(int frameSize, int payloadSize)
+{
+    int fcs = fcsSize(linkConfig.fcsType);
+    int header = I_HEADER_SIZE + 1;     // F, A, C, BCC1 and the closing F
+
+    stats.wirePayloadBytes += payloadSize;
+    stats.wireHeaderBytes += header;
+    stats.wireFcsBytes += fcs;
+    stats.wireStuffingBytes += frameSize - header - payloadSize - fcs;
+}
+
+/**
+ * @brief Writes a whole frame to the serial port, retrying partial writes.
+ *
+ * A write interrupted by a signal may return early, so the remaining bytes
+ * are written until the frame is complete. Also advances
+ * lineFreeAt by the time the frame takes on the line.
+ *
+ * @param frame The frame to send.
+ * @param frameSize The size of the frame.
+ * @return 0 on success, -1 on write failure.
+ */
+static int writeFrame(const unsigned char *frame, int frameSize)
+{
+    int written = 0;
+    PROFILE_BEGIN(PROF_IO_WAIT);
+    while (written < frameSize) {
+        int n = writeBytesSerialPort(frame + written, frameSize - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            logError("Erro: falha ao escrever frame (%d/%d bytes)\n", written, frameSize);
+            PROFILE_END(PROF_IO_WAIT);
+            return -1;
+        }
+        written += n;
+    }
+    PROFILE_END(PROF_IO_WAIT);
+
+    double now = currentTimeMs();
+    if (lineFreeAt < now) lineFreeAt = now;
+    lineFreeAt += frameSize * BITS_PER_BYTE * 1000.0 / globalBaudRate;
+    stats.wireBytes += frameSize;
+    return 0;
+}
+
+/**
+ * @brief Delay for the retransmission timer of a frame.
+ *
+ * The RTO covers the round trip once the frame is on the wire; the time the
+ * frame still needs to leave the line is added to it.
+ *
+ * @param doneAt When the frame finishes leaving the line (see lineFreeAt).
+ * @return The delay in milliseconds (at least 1).
+ */
+static int retransmissionDelayMs(double doneAt)
+{
+    double pending = doneAt - currentTimeMs();
+    if (pending < 0) pending = 0;
+    int delay = (int)pending + rttTimeoutMs();
+    return delay > 0 ? delay : 1;
+}
+
+/**
+ * @brief Builds and sends a Supervisory (S) or Unnumbered (U) frame.
+ *
+ * @return 0 on success, -1 on write failure.
+ */
+static int sendSUFrame(unsigned char address, unsigned char control)
+{
+    unsigned char frame[SUFrame_SIZE];
+    buildSUFrame(frame, address, control);
+    return writeFrame(frame, SUFrame_SIZE);
+}
+
+// =================================================================
+// SERIAL PORT WRITE WITH ALARM/RETRANSMISSION
+// =================================================================
+
+/**
+ * @brief Writes a frame to the serial port and arms the retransmission timer.
+ *
+ * This function only sends the frame if the timer is not already running (i.e.,
+ * if we're not waiting for an acknowledgment). The timer is set to the current
+ * RTO (see rtt_estimator.h) plus the time the frame takes on the line.
+ *
+ * @param frame The frame to send.
+ * @param frameSize The size of the frame.
+ * @param nRetransmissions Pointer to the retransmission counter (decremented externally upon timeout).
+ * @return 0 on success, -1 on fatal error (max retransmissions reached or write failure).
+ */
+
+int writeToSerialPort(unsigned char *frame, int frameSize, int *nRetransmissions)
+{
+    if (*nRetransmissions < 0) {
+        logError("ERROR: Maximum retransmissions reached.\n");
+        return -1;
+    }
+    
+    if (!timerPending(&linkLoop, retransmissionTimer)) {
+        if (writeFrame(frame, frameSize) < 0) return -1;
+
+        /*
+        printf("Frame sent. Waiting for response... (retransmissions left: %d)\n", *nRetransmissions);
+        */
+
+        armTimer(&linkLoop, retransmissionTimer, retransmissionDelayMs(lineFreeAt));
+        return 0;
+    }
+    
+    return 0;
+}
+
+//===============================================
+// TRANSMITTER WINDOW
+//===============================================
+
+/**
+ * @brief Arms the retransmission timer for the frame at txBase.
+ */
+static void startRetransmissionTimer()
+{
+    armTimer(&linkLoop, retransmissionTimer, retransmissionDelayMs(txWindow[txHead].doneAt));
+}
+
+static void stopRetransmissionTimer()
+{
+    disarmTimer(&linkLoop, retransmissionTimer);
+}
+
+/**
+ * @brief Allocates the retransmission buffer for the configured window.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int allocTxWindow()
+{
+    txWindow = calloc(linkConfig.windowSize, sizeof(TxSlot));
+    if (txWindow == NULL) return -1;
+
+    for (int i = 0; i < linkConfig.windowSize; i++) {
+        txWindow[i].frame = malloc(IFRAME_CAPACITY(linkConfig.maxPayload));
+        if (txWindow[i].frame == NULL) return -1;
+    }
+
+    txBase = 0;
+    txHead = 0;
+    txOutstanding = 0;
+    return 0;
+}
+
+/**
+ * @brief Allocates the reorder buffer used by the receiver in Selective Repeat mode.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int allocRxWindow()
+{
+    rxWindow = calloc(SEQ_MODULUS_WINDOW, sizeof(RxSlot));
+    if (rxWindow == NULL) return -1;
+
+    for (int i = 0; i < SEQ_MODULUS_WINDOW; i++) {
+        rxWindow[i].data = malloc(linkConfig.maxPayload);
+        if (rxWindow[i].data == NULL) return -1;
+    }
+
+    rxDeliver = 0;
+    return 0;
+}
+
+/**
+ * @brief Releases the receive buffers (data field and reorder buffer).
+ */
+static void freeRxWindow()
+{
+    free(rxDataBuffer);
+    rxDataBuffer = NULL;
+
+    if (rxWindow == NULL) return;
+    for (int i = 0; i < SEQ_MODULUS_WINDOW; i++) {
+        free(rxWindow[i].data);
+    }
+    free(rxWindow);
+    rxWindow = NULL;
+}
+
+static void freeTxWindow()
+{
+    if (txWindow == NULL) return;
+    for (int i = 0; i < linkConfig.windowSize; i++) {
+        free(txWindow[i].frame);
+    }
+    free(txWindow);
+    txWindow = NULL;
+}
+
+/**
+ * @brief Resends the outstanding frame with sequence number "seq" (Selective Repeat).
+ *
+ * @return 0 on success, -1 on write failure or when the frame ran out of retransmissions.
+ */
+static int retransmitFrame(int seq)
+{
+    int offset = seqDistance(txBase, seq);
+    if (offset >= txOutstanding) return 0;
+
+    TxSlot *slot = &txWindow[(txHead + offset) % linkConfig.windowSize];
+    if (--slot->retriesLeft < 0) {
+        logError("TX: ERROR - Maximum retransmissions reached.\n");
+        return -1;
+    }
+    if (writeFrame(slot->frame, slot->size) < 0) return -1;
+    stats.framesRetransmitted++;
+    stats.wireRetransmittedBytes += slot->size;
+    TRACE_EVENT(EV_I_RETRANSMITTED, seq, 0, slot->size, 0);
+    slot->doneAt = lineFreeAt;
+    slot->retransmitted = TRUE;
+
+    if (offset == 0) startRetransmissionTimer();
+    return 0;
+}
+
+/**
+ * @brief Resends every outstanding frame, starting at txBase (Go-Back-N).
+ *
+ * @return 0 on success, -1 on write failure or when txBase ran out of retransmissions.
+ */
+static int retransmitWindow()
+{
+    if (--txWindow[txHead].retriesLeft < 0) {
+        logError("TX: ERROR - Maximum retransmissions reached.\n");
+        return -1;
+    }
+    for (int i = 0; i < txOutstanding; i++) {
+        TxSlot *slot = &txWindow[(txHead + i) % linkConfig.windowSize];
+        if (writeFrame(slot->frame, slot->size) < 0) return -1;
+        stats.framesRetransmitted++;
+        stats.wireRetransmittedBytes += slot->size;
+        TRACE_EVENT(EV_I_RETRANSMITTED, (txBase + i) % seqModulus, 0, slot->size, 0);
+        slot->doneAt = lineFreeAt;
+        slot->retransmitted = TRUE;
+    }
+    startRetransmissionTimer();
+    return 0;
+}
+
+/**
+ * @brief Applies a cumulative acknowledgement: every frame before "seq" was received.
+ *
+ * The RR for a frame is sent as soon as it arrives, so the newest frame released
+ * gives an RTT sample, unless it was retransmitted (Karn's rule). Every frame
+ * released adds its ack latency, retransmissions included, to the statistics.
+ *
+ * @param seq The Nr carried by the RR/REJ frame.
+ * @return The number of frames released from the window.
+ */
+static int releaseAcknowledged(int seq)
+{
+    int acked = seqDistance(txBase, seq);
+    if (acked == 0 || acked > txOutstanding) return 0;
+
+    double now = currentTimeMs();
+    for (int i = 0; i < acked; i++) {
+        recordLatency(&stats.ackLatency, now - txWindow[(txHead + i) % linkConfig.windowSize].sentAt);
+    }
+
+    TxSlot *newest = &txWindow[(txHead + acked - 1) % linkConfig.windowSize];
+    if (!newest->retransmitted) rttSample(now - newest->doneAt);
+
+    txBase = seq;
+    txHead = (txHead + acked) % linkConfig.windowSize;
+    txOutstanding -= acked;
+
+    if (txOutstanding > 0) startRetransmissionTimer();
+    else stopRetransmissionTimer();
+
+    return acked;
+}
+
+/**
+ * @brief Handles a complete RR, REJ or SREJ frame received from the receiver.
+ *
+ * @return 0 on success, -1 when the retransmission limit was reached.
+ */
+static int handleAck(unsigned char control)
+{
+    int seq = controlToSeq(control);
+
+    if ((control & C_TYPE_MASK) == C_TYPE_RR) {
+        int released = releaseAcknowledged(seq);
+        if (released > 0) {
+            TRACE_EVENT(EV_RR_RECEIVED, 0, seq, 0, released);
+            logFrame("TX: RR%d received. Window: %d frame(s) outstanding.\n", seq, txOutstanding);
+        }
+        return 0;
+    }
+
+    if ((control & C_TYPE_MASK) == C_TYPE_SREJ) {
+        // SREJ: only that frame is missing, the rest of the window stays in flight
+        if (seqDistance(txBase, seq) >= txOutstanding) return 0;
+        stats.rejReceived++;
+        TRACE_EVENT(EV_SREJ_RECEIVED, 0, seq, 0, 0);
+        logFrame("TX: SREJ%d received — retransmitting that frame.\n", seq);
+        return retransmitFrame(seq);
+    }
+
+    // REJ: frames before seq are acknowledged, seq and everything after it is resent
+    releaseAcknowledged(seq);
+    if (txOutstanding == 0 || seq != txBase) return 0;
+
+    stats.rejReceived++;
+    TRACE_EVENT(EV_REJ_RECEIVED, 0, seq, 0, txOutstanding);
+    logFrame("TX: REJ%d received — retransmitting %d frame(s).\n", seq, txOutstanding);
+    return retransmitWindow();
+}
+
+/**
+ * @brief Reads acknowledgements from the receiver and services the retransmission timer.
+ *
+ * @param block If TRUE, waits until an acknowledgement arrives or the timer expires.
+ *              If FALSE, only consumes the bytes that are already available.
+ * @return 1 if an RR/REJ was processed, 0 if nothing happened, -1 on fatal error.
+ */
+static int processAcks(bool block)
+{
+    const unsigned char *body;
+
+    while (txOutstanding > 0) {
+        if (!timerPending(&linkLoop, retransmissionTimer)) {
+            stats.timeouts++;
+            rttBackoff();
+            TRACE_EVENT(EV_TIMEOUT, txBase, 0, 0, rttTimeoutMs());
+            if (linkConfig.arqMode == ARQ_SELECTIVE_REPEAT) {
+                // The receiver keeps what arrived after txBase, so only txBase is resent
+                logFrame("TX: Timeout — retransmitting Ns=%d (RTO now %d ms).\n", txBase, rttTimeoutMs());
+                if (retransmitFrame(txBase) < 0) return -1;
+            } else {
+                logFrame("TX: Timeout — retransmitting %d frame(s) from Ns=%d (RTO now %d ms).\n", txOutstanding, txBase, rttTimeoutMs());
+                if (retransmitWindow() < 0) return -1;
+            }
+            return 0;
+        }
+
+        // Time blocked here once the line has sent everything is time lost waiting for acks
+        double waitFrom = (lineFreeAt > currentTimeMs()) ? lineFreeAt : currentTimeMs();
+        int size = readLinkFrame(&body, block);
+        if (block && currentTimeMs() > waitFrom) stats.ackWaitMs += currentTimeMs() - waitFrom;
+        if (size < 0) return -1;
+        if (size == 0) {
+            if (!block) return 0;
+            continue;
+        }
+
+        if (size != FRAME_HEADER_SIZE || !isValidHeader(body, size, A_RX)) continue;
+
+        unsigned char type = body[1] & C_TYPE_MASK;
+        if (type == C_TYPE_RR || type == C_TYPE_REJ || type == C_TYPE_SREJ) {
+            return (handleAck(body[1]) < 0) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Waits until every frame in the window has been acknowledged.
+ *
+ * @return 0 on success, -1 if the retransmission limit was reached.
+ */
+static int flushWindow()
+{
+    while (txOutstanding > 0) {
+        if (processAcks(TRUE) < 0) return -1;
+    }
+    return 0;
+}
+
+//===============================================
+// PARAMETER NEGOTIATION
+//===============================================
+
+/**
+ * @brief Makes the values agreed with the peer the configuration of the link.
+ *
+ * @param local Values supported by this end (from loadLinkConfig).
+ * @param peer Values received in SET (receiver) or UA (transmitter).
+ * @param negotiates FALSE if the peer sent no capabilities: its fixed values are used.
+ */
+static void applyLinkConfig(const LinkConfig *local, const LinkConfig *peer, bool negotiates)
+{
+    if (negotiates) {
+        negotiateLinkConfig(local, peer, &linkConfig);
+    } else {
+        linkConfig = legacyLinkConfig;
+    }
+    seqModulus = (linkConfig.arqMode == ARQ_STOP_AND_WAIT) ? SEQ_MODULUS_SAW : SEQ_MODULUS_WINDOW;
+
+    logInfo("CONFIG: arq=%s window=%d payload=%d fcs=%s\n", arqModeName(linkConfig.arqMode),
+           linkConfig.windowSize, linkConfig.maxPayload, fcsName(linkConfig.fcsType));
+}
+
+//===============================================
+// LLOPEN (Connection Setup)
+//===============================================
+
+/**
+ * @brief Establishes the connection at the link layer.
+ *
+ * Implements the HDLC SABM/UA exchange (three-wire handshake).
+ *
+ * @param connectionParameters LinkLayer structure containing role, port, etc.
+ * @return File descriptor (fd) on success, -1 on failure.
+ */
+
+int llopen(LinkLayer connectionParameters)
+{
+    fd = openSerialPort(connectionParameters.serialPort, connectionParameters.baudRate);
+    if (fd < 0) {
+        perror("openSerialPort");
+        return -1;
+    }
+
+    globalRole = connectionParameters.role;
+    globalTimeout = connectionParameters.timeout;
+    globalNRetransmissions = connectionParameters.nRetransmissions;
+    globalBaudRate = connectionParameters.baudRate;
+    lineFreeAt = 0;
+
+    // No RTT measured yet: the configured timeout is the first RTO
+    initRttEstimator(globalTimeout * 1000);
+
+    // The values this end supports; linkConfig is replaced by the agreed ones
+    loadLinkConfig();
+    LinkConfig local = linkConfig;
+
+    if (initEventLoop(&linkLoop) < 0 || (retransmissionTimer = createTimer(&linkLoop)) < 0) {
+        perror("initEventLoop");
+        freeEventLoop(&linkLoop);
+        closeSerialPort();
+        return -1;
+    }
+    sampleTimer = -1;
+    if (statsSampleIntervalMs() > 0 && (sampleTimer = createTimer(&linkLoop)) >= 0) {
+        armTimer(&linkLoop, sampleTimer, statsSampleIntervalMs());
+    }
+
+    // Never more than the local limit is agreed (or the fixed one of a peer
+    // that does not negotiate), so the reader is sized for it
+    int maxPayload = (local.maxPayload > legacyLinkConfig.maxPayload) ? local.maxPayload : legacyLinkConfig.maxPayload;
+    if (initFrameReader(IFRAME_CAPACITY(maxPayload), &linkLoop) < 0) {
+        perror("initFrameReader");
+        freeEventLoop(&linkLoop);
+        closeSerialPort();
+        return -1;
+    }
+
+    if (connectionParameters.role == LlTx) {
+        logInfo("TX: Sending SET frame...\n");
+        
+        // A receiver that does not negotiate ignores a SET with capabilities, so the
+        // last try is a plain SET; the UA tells which one was answered. Only the last,
+        // so a lost SET between two ends that negotiate does not cost the options
+        unsigned char capabilitiesSet[MAX_UFRAME_SIZE];
+        int capabilitiesSetSize = buildCapabilitiesFrame(capabilitiesSet, A_TX, C_SET, &local);
+        unsigned char plainSet[SUFrame_SIZE];
+        buildSUFrame(plainSet, A_TX, C_SET);
+        
+        int nRetransmissions = connectionParameters.nRetransmissions -1;
+        
+        const unsigned char *body;
+        LinkConfig peer;
+        
+        disarmTimer(&linkLoop, retransmissionTimer);
+        double setSentAt = currentTimeMs();
+        
+        while (nRetransmissions >= 0) {
+            // Only the first SET gives an unambiguous sample (Karn's rule)
+            int attempt = connectionParameters.nRetransmissions - 1 - nRetransmissions;
+            bool firstAttempt = (attempt == 0);
+            bool plainAttempt = (nRetransmissions == 0 && attempt > 0);
+            unsigned char *setFrame = plainAttempt ? plainSet : capabilitiesSet;
+            int setFrameSize = plainAttempt ? SUFrame_SIZE : capabilitiesSetSize;
+            writeToSerialPort(setFrame, setFrameSize, &nRetransmissions);
+            TRACE_EVENT(EV_SET, 0, 0, setFrameSize, attempt);
+            double setDoneAt = lineFreeAt;
+            
+            while (timerPending(&linkLoop, retransmissionTimer)) {
+                int size = readLinkFrame(&body, TRUE);
+                if (size < 0) break;
+                int capabilities;
+                if (isUFrame(body, size, A_RX, C_UA) && (capabilities = parseCapabilities(body, size, &peer)) >= 0) {
+                    disarmTimer(&linkLoop, retransmissionTimer);
+                    if (firstAttempt) rttSample(currentTimeMs() - setDoneAt);
+                    recordLatency(&stats.setLatency, currentTimeMs() - setSentAt);
+                    TRACE_EVENT(EV_UA, 0, 0, size, 0);
+                    logInfo("TX: UA received. Connection established.\n");
+
+                    if (capabilities == 1) {
+                        logError("TX: WARNING -> The receiver answered the plain SET: "
+                                 "no options are negotiated (saw, xor, %d bytes)\n", legacyLinkConfig.maxPayload);
+                    }
+                    applyLinkConfig(&local, &peer, capabilities == 0);
+                    if (allocTxWindow() < 0) {
+                        perror("allocTxWindow");
+                        freeTxWindow();
+                        freeFrameReader();
+                        freeEventLoop(&linkLoop);
+                        closeSerialPort();
+                        return -1;
+                    }
+
+                    Ns = 0;
+                    logInfo(" \n fd do tx - >\"%d\" \n",fd);
+                    return fd;
+                }
+            }
+            
+            if (!timerPending(&linkLoop, retransmissionTimer)) {
+                nRetransmissions--;
+                rttBackoff();
+                logInfo("TX: Timeout or REJ! Retransmitting...\n");
+            }
+        }
+        
+        logError("TX: ERROR - Failed to establish connection after all retries.\n");
+        freeFrameReader();
+        freeEventLoop(&linkLoop);
+        closeSerialPort();
+        return -1;
+        
+    } else {
+        logInfo("RX: Waiting for SET frame...\n");
+        
+        const unsigned char *body;
+        int size;
+        LinkConfig peer;
+        int capabilities = -1;
+        
+        do {
+            size = readLinkFrame(&body, TRUE);
+            if (size < 0) {
+                freeFrameReader();
+                freeEventLoop(&linkLoop);
+                closeSerialPort();
+                return -1;
+            }
+        } while (!isUFrame(body, size, A_TX, C_SET) || (capabilities = parseCapabilities(body, size, &peer)) < 0);
+        
+        TRACE_EVENT(EV_SET, 0, 0, size, 0);
+        logInfo("RX: SET received. Sending UA...\n");
+
+        applyLinkConfig(&local, &peer, capabilities == 0);
+
+        // A transmitter that does not negotiate expects the plain UA
+        if (capabilities == 1) {
+            buildSUFrame(uaFrame, A_RX, C_UA);
+            uaFrameSize = SUFrame_SIZE;
+        } else {
+            uaFrameSize = buildCapabilitiesFrame(uaFrame, A_RX, C_UA, &linkConfig);
+        }
+        
+        if (writeFrame(uaFrame, uaFrameSize) < 0) {
+            perror("writeBytesSerialPort - UA");
+            return -1;
+        }
+        
+        Nr = 0;
+        rxDataBuffer = malloc(linkConfig.maxPayload + FCS_MAX_SIZE);
+        if (rxDataBuffer == NULL ||
+            (linkConfig.arqMode == ARQ_SELECTIVE_REPEAT && allocRxWindow() < 0)) {
+            perror("allocRxWindow");
+            freeRxWindow();
+            freeFrameReader();
+            freeEventLoop(&linkLoop);
+            closeSerialPort();
+            return -1;
+        }
+        logInfo(" \n fd do rx - >\"%d\" \n",fd);
+        return fd;
+    }
+}
+
+//===============================================
+// LLWRITE (Data Transmission)
+//===============================================
+
+/**
+ * @brief Transmits an Information (I) frame containing the application layer data.
+ *
+ * The frame is stuffed straight into a free slot of the retransmission buffer and
+ * sent. In Go-Back-N mode the call returns as soon as the window has room for the
+ * next frame; acknowledgements are cumulative and a timeout or REJ resends every
+ * outstanding frame. With a window of one (Stop-and-Wait) this means waiting for
+ * the RR of the frame just sent.
+ *
+ * @param buf Pointer to the raw application layer data payload.
+ * @param bufSize Size of the payload.
+ * @return The number of bytes successfully written (bufSize), or -1 on failure.
+ */
+int llwrite(const unsigned char *buf, int bufSize)
+{
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = bufSize};
+    return llwritev(&iov, 1);
+}
+
+/**
+ * @brief Sends an I-frame whose payload is split in several blocks.
+ *
+ * Same as llwrite, but the blocks are stuffed into the frame slot directly,
+ * so the caller does not need to assemble the packet in a buffer of its own.
+ *
+ * @param iov Blocks of the payload, in order.
+ * @param iovcnt Number of blocks (at most LL_IOV_MAX).
+ * @return The payload size on success, or -1 on failure.
+ */
+int llwritev(const struct iovec *iov, int iovcnt)
+{
+    if (iovcnt < 1 || iovcnt > LL_IOV_MAX) return -1;
+
+    int bufSize = 0;
+    for (int i = 0; i < iovcnt; i++) bufSize += iov[i].iov_len;
+
+    TxSlot *slot = &txWindow[(txHead + txOutstanding) % linkConfig.windowSize];
+    PROFILE_BEGIN(PROF_FRAMING);
+    slot->size = buildIFrame(slot->frame, iov, iovcnt);
+    PROFILE_END(PROF_FRAMING);
+    if (slot->size < 0) {
+        logError("Erro: buildIFrame falhou\n");
+        return -1;
+    }
+
+    slot->sentAt = currentTimeMs();
+    if (writeFrame(slot->frame, slot->size) < 0) return -1;
+    stats.framesTransmitted++;
+    stats.iFrameBytes += bufSize;
+    countIFrameBytes(slot->size, bufSize);
+    TRACE_EVENT(EV_I_SENT, Ns, 0, slot->size, 0);
+    logFrame("TX: I-Frame sent (Ns=%d).\n", Ns);
+
+    slot->retriesLeft = globalNRetransmissions - 1;
+    slot->doneAt = lineFreeAt;
+    slot->retransmitted = FALSE;
+    if (txOutstanding == 0) startRetransmissionTimer();
+    txOutstanding++;
+    Ns = (Ns + 1) % seqModulus;
+
+    // Consume the acknowledgements that already arrived, then block only if the window is full
+    int res;
+    while ((res = processAcks(FALSE)) > 0);
+    if (res < 0) {
+        logError("TX: ERROR - Failed to send I-Frame after all retries.\n");
+        return -1;
+    }
+
+    while (txOutstanding == linkConfig.windowSize) {
+        if (processAcks(TRUE) < 0) {
+            logError("TX: ERROR - Failed to send I-Frame after all retries.\n");
+            return -1;
+        }
+    }
+
+    return bufSize;
+}
+
+//===============================================
+// LLREAD (Data Reception)
+//===============================================
+
+/**
+ * @brief Reads an Information (I) frame from the serial port and extracts the payload.
+ *
+ * Takes the frames delimited by the receive engine, performs destuffing, and checks the FCS.
+ * Only the frame with Ns == Nr is accepted; RR(Nr) acknowledges every frame before it.
+ * Old (duplicate) frames are answered with RR(Nr). In Go-Back-N mode, frames that arrive
+ * ahead of Nr mean one was lost: they are discarded and a single REJ(Nr) is sent until
+ * the missing frame arrives. In Selective Repeat mode they are kept in the reorder buffer,
+ * a SREJ is sent for each missing frame, and once the gap is filled the buffered frames
+ * are returned by the following llread calls without touching the serial port.
+ *
+ * @param packet Pointer to the buffer where the application layer payload will be stored.
+ * @return The size of the extracted payload on success, or -1 on failure.
+ */
+int llread(unsigned char *packet)
+{
+    // Set when a REJ for the current Nr was already sent, so out-of-sequence
+    // frames do not trigger one REJ each
+    static bool rejPending = FALSE;
+
+    // Frames completed by an earlier retransmission are handed over first
+    if (rxWindow != NULL && rxDeliver != Nr) {
+        RxSlot *slot = &rxWindow[rxDeliver];
+        int size = slot->size;
+        memcpy(packet, slot->data, size);
+        slot->valid = FALSE;
+        rxDeliver = (rxDeliver + 1) % seqModulus;
+        return size;
+    }
+
+    const unsigned char *body;
+
+    // Buffer to the payload (data + FCS) extracted from the I-Frame
+    unsigned char *dataBuffer = rxDataBuffer;
+
+    while (TRUE) {
+        int size = readLinkFrame(&body, TRUE);
+        if (size < 0) return -1;
+
+        // The UA was lost and the transmitter repeated the SET
+        if (isUFrame(body, size, A_TX, C_SET)) {
+            TRACE_EVENT(EV_SET, 0, 0, size, 1);
+            logInfo("RX: SET received again. Sending UA...\n");
+            if (writeFrame(uaFrame, uaFrameSize) < 0) return -1;
+            continue;
+        }
+
+        if (size <= FRAME_HEADER_SIZE) continue;
+
+        if (!isValidHeader(body, size, A_TX)) {
+            // A, C or BCC1 was corrupted but a data field and the closing FLAG followed:
+            // most likely the I-frame the receiver is waiting for. Its Ns is unknown,
+            // so ask for Nr instead of letting the transmitter wait for a timeout
+            stats.bcc1Errors++;
+            if (rxWindow != NULL) {
+                if (rxWindow[Nr].srejSent) continue;
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_SREJ | seqToControl(Nr)) < 0) return -1;
+                TRACE_EVENT(EV_HEADER_ERROR, 0, Nr, size, 0);
+                logFrame("RX: Header error. Sent SREJ%d.\n", Nr);
+                rxWindow[Nr].srejSent = TRUE;
+            } else if (linkConfig.arqMode == ARQ_STOP_AND_WAIT || !rejPending) {
+                // Go-Back-N: one REJ per loss, the transmitter already goes back to Nr.
+                // Stop-and-Wait: every damaged copy of the one frame in flight gets its REJ
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_REJ | seqToControl(Nr)) < 0) return -1;
+                TRACE_EVENT(EV_HEADER_ERROR, 0, Nr, size, 0);
+                logFrame("RX: Header error. Sent REJ%d.\n", Nr);
+                rejPending = TRUE;
+            }
+            continue;
+        }
+
+        // Only I-frames from the transmitter
+        if (!isIFrameControl(body[1])) continue;
+
+        int seq = controlToSeq(body[1]);
+        int distance = seqDistance(Nr, seq);
+        bool inWindow = distance < linkConfig.windowSize;
+
+        if (distance != 0 && inWindow && linkConfig.arqMode == ARQ_GO_BACK_N) {
+            // Ahead of Nr: a previous frame was lost
+            TRACE_EVENT(EV_OUT_OF_SEQUENCE, seq, Nr, size, 0);
+            logFrame("RX: Out-of-sequence frame (got Ns=%d, expected %d)\n", seq, Nr);
+            if (!rejPending) {
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_REJ | seqToControl(Nr)) < 0) return -1;
+                TRACE_EVENT(EV_REJ_SENT, 0, Nr, 0, 0);
+                logFrame("RX: Sent REJ%d.\n", Nr);
+                rejPending = TRUE;
+            }
+            continue;
+        }
+
+        if (!inWindow || (rxWindow != NULL && distance != 0 && rxWindow[seq].valid)) {
+            stats.duplicateFrames++;
+            // Duplicated Frame
+            TRACE_EVENT(EV_DUPLICATE, seq, Nr, size, 0);
+            logFrame("RX: Duplicate frame detected (got Ns=%d, expected %d)\n", seq, Nr);
+            
+            // RR sent to confirm what is already expect
+            if (sendSUFrame(A_RX, C_TYPE_RR | seqToControl(Nr)) < 0) return -1;
+            continue;
+        }
+
+        PROFILE_BEGIN(PROF_FRAMING);
+        int dataSize = readPayload(body, size, dataBuffer, linkConfig.maxPayload);
+        PROFILE_END(PROF_FRAMING);
+        if (dataSize == PAYLOAD_INVALID) {
+            // Buffer overflow or broken escape, Frame discarded
+            TRACE_EVENT(EV_FCS_ERROR, seq, Nr, size, 1);
+            logFrame("RX: Invalid data field. Frame discarded.\n");
+            continue;
+        }
+
+        if (dataSize == PAYLOAD_FCS_ERROR) {
+            stats.bcc2Errors++;
+            TRACE_EVENT(EV_FCS_ERROR, seq, Nr, size, 0);
+            if (rxWindow != NULL) {
+                // As for a header error: one SREJ per missing frame of the window
+                if (!inWindow || rxWindow[seq].srejSent) continue;
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_SREJ | seqToControl(seq)) < 0) return -1;
+                TRACE_EVENT(EV_SREJ_SENT, 0, seq, 0, 0);
+                logFrame("RX: Frame error. Sent SREJ%d.\n", seq);
+                rxWindow[seq].srejSent = TRUE;
+            } else if (linkConfig.arqMode == ARQ_STOP_AND_WAIT || !rejPending) {
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_REJ | seqToControl(Nr)) < 0) return -1;
+                TRACE_EVENT(EV_REJ_SENT, 0, Nr, 0, 0);
+                logFrame("RX: Frame error. Sent REJ%d.\n", Nr);
+                rejPending = TRUE;
+            }
+            continue;
+        }
+
+        stats.framesReceivedCorrectly++;
+        stats.iFrameBytes += dataSize;
+
+        if (seq != Nr) {
+            // Selective Repeat: keep it until the frames before it arrive
+            RxSlot *slot = &rxWindow[seq];
+            memcpy(slot->data, dataBuffer, dataSize);
+            slot->size = dataSize;
+            slot->valid = TRUE;
+            slot->srejSent = FALSE;
+            TRACE_EVENT(EV_I_BUFFERED, seq, Nr, dataSize, 0);
+            logFrame("RX: I-Frame Ns=%d buffered (expected %d).\n", seq, Nr);
+
+            for (int missing = Nr; missing != seq; missing = (missing + 1) % seqModulus) {
+                if (rxWindow[missing].valid || rxWindow[missing].srejSent) continue;
+                stats.rejSent++;
+                if (sendSUFrame(A_RX, C_TYPE_SREJ | seqToControl(missing)) < 0) return -1;
+                TRACE_EVENT(EV_SREJ_SENT, 0, missing, 0, 0);
+                logFrame("RX: Sent SREJ%d.\n", missing);
+                rxWindow[missing].srejSent = TRUE;
+            }
+            continue;
+        }
+
+        // Valid data
+        memcpy(packet, dataBuffer, dataSize);
+        
+        Nr = (Nr + 1) % seqModulus;
+        rxDeliver = Nr;
+        rejPending = FALSE;
+
+        // Frames buffered after the one just received are now in sequence
+        if (rxWindow != NULL) {
+            rxWindow[seq].srejSent = FALSE;
+            while (rxWindow[Nr].valid) {
+                rxWindow[Nr].srejSent = FALSE;
+                Nr = (Nr + 1) % seqModulus;
+            }
+        }
+
+        if (sendSUFrame(A_RX, C_TYPE_RR | seqToControl(Nr)) < 0) return -1;
+        
+        TRACE_EVENT(EV_I_RECEIVED, seq, Nr, dataSize, 0);
+        logFrame("RX: I-Frame received (Ns=%d). Sent RR%d.\n", seq, Nr);
+        return dataSize;
+    }
+}
+
+//===============================================
+// REPLY FRAMES (Receiver to Transmitter)
+//===============================================
+
+/*
+ * I-frames only flow from the transmitter. A reply frame lets the receiver answer
+ * one message (e.g. the START packet) without a second data channel:
+ *   F | A_RX | C_TYPE_I | BCC1 | Data (stuffed) | FCS (stuffed) | F
+ * It is sent after the RR of the frame it answers. The transmitter acknowledges it with
+ * an RR from A_TX; the receiver repeats it on timeout, like any I-frame. Only used
+ * when both ends announced CAP_REPLY in llopen.
+ */
+
+/**
+ * @brief Sends a reply frame to the transmitter and waits for its acknowledgement.
+ *
+ * The transmitter only sends new I-frames after it got the reply, so one of them
+ * also acknowledges it; it is handed back to the frame reader for the next llread.
+ * A repeated I-frame (its RR was lost) is acknowledged again.
+ *
+ * @param buf Message to send.
+ * @param bufSize Its size (at most MAX_REPLY_SIZE).
+ * @return 0 on success, -1 on error or when the retransmissions ran out.
+ */
+int llreply(const unsigned char *buf, int bufSize)
+{
+    if (globalRole != LlRx || !linkConfig.replyFrames || bufSize > MAX_REPLY_SIZE) return -1;
+
+    unsigned char frame[IFRAME_CAPACITY(MAX_REPLY_SIZE)];
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = bufSize};
+    int frameSize = buildInfoFrame(frame, A_RX, C_TYPE_I, &iov, 1);
+    if (frameSize < 0) return -1;
+
+    const unsigned char *body;
+    double sentAt = currentTimeMs();
+
+    for (int attempt = 0; attempt < globalNRetransmissions; attempt++) {
+        if (writeFrame(frame, frameSize) < 0) return -1;
+        if (attempt > 0) {
+            stats.framesRetransmitted++;
+            stats.wireRetransmittedBytes += frameSize;
+        } else {
+            countIFrameBytes(frameSize, bufSize);
+        }
+        TRACE_EVENT(EV_REPLY_SENT, 0, 0, bufSize, attempt);
+        double doneAt = lineFreeAt;
+        armTimer(&linkLoop, retransmissionTimer, retransmissionDelayMs(doneAt));
+
+        while (timerPending(&linkLoop, retransmissionTimer)) {
+            int size = readLinkFrame(&body, TRUE);
+            if (size < 0) return -1;
+            if (size == 0 || !isValidHeader(body, size, A_TX)) continue;
+
+            bool acked = (size == FRAME_HEADER_SIZE && (body[1] & C_TYPE_MASK) == C_TYPE_RR);
+            if (!acked && size > FRAME_HEADER_SIZE && isIFrameControl(body[1])) {
+                if (controlToSeq(body[1]) != Nr) {
+                    // The RR of the frame answered was lost
+                    if (sendSUFrame(A_RX, C_TYPE_RR | seqToControl(Nr)) < 0) return -1;
+                    continue;
+                }
+                unreadFrame();
+                acked = TRUE;
+            }
+
+            if (acked) {
+                disarmTimer(&linkLoop, retransmissionTimer);
+                if (attempt == 0) rttSample(currentTimeMs() - doneAt);
+                recordLatency(&stats.ackLatency, currentTimeMs() - sentAt);
+                logFrame("RX: Reply acknowledged.\n");
+                return 0;
+            }
+        }
+
+        stats.timeouts++;
+        rttBackoff();
+        logFrame("RX: Timeout — sending the reply again.\n");
+    }
+
+    logError("RX: ERROR - Reply not acknowledged after all retries.\n");
+    return -1;
+}
+
+/**
+ * @brief Waits for the reply frame sent by the receiver with llreply.
+ *
+ * Every outstanding I-frame is acknowledged first. The receiver repeats the reply
+ * up to nRetransmissions times, so the wait ends after that many timeouts.
+ *
+ * @param buf Receives the message (MAX_REPLY_SIZE bytes).
+ * @return The message size, or -1 on error or if no reply arrived.
+ */
+int llreadreply(unsigned char *buf)
+{
+    if (globalRole != LlTx || !linkConfig.replyFrames) return -1;
+    if (flushWindow() < 0) return -1;
+
+    unsigned char data[MAX_REPLY_SIZE + FCS_MAX_SIZE];
+    const unsigned char *body;
+
+    armTimer(&linkLoop, retransmissionTimer, globalNRetransmissions * (rttTimeoutMs() + globalTimeout * 1000));
+    while (timerPending(&linkLoop, retransmissionTimer)) {
+        int size = readLinkFrame(&body, TRUE);
+        if (size < 0) break;
+        if (size <= FRAME_HEADER_SIZE || !isValidHeader(body, size, A_RX) || body[1] != C_TYPE_I) continue;
+
+        int dataSize = readPayload(body, size, data, MAX_REPLY_SIZE);
+        if (dataSize < 0) continue;
+
+        disarmTimer(&linkLoop, retransmissionTimer);
+        if (sendSUFrame(A_TX, C_TYPE_RR) < 0) return -1;
+        memcpy(buf, data, dataSize);
+        TRACE_EVENT(EV_REPLY_RECEIVED, 0, 0, dataSize, 0);
+        logFrame("TX: Reply received (%d bytes).\n", dataSize);
+        return dataSize;
+    }
+
+    disarmTimer(&linkLoop, retransmissionTimer);
+    logError("TX: ERROR - No reply from the receiver.\n");
+    return -1;
+}
+
+//===============================================
+// LLCLOSE (Connection Teardown)
+//===============================================
+
+/**
+ * @brief Closes the connection at the link layer.
+ *
+ * Implements the HDLC DISC/DISC/UA exchange.
+ *
+ * @return 0 on successful closure, -1 on failure.
+ */
+int llclose()
+{
+    if( globalRole == LlTx ){
+        // Every I-frame must be acknowledged before the disconnection starts
+        if (flushWindow() < 0) {
+            logError("TX: ERROR - Unacknowledged I-Frames discarded.\n");
+        }
+        freeTxWindow();
+
+        logInfo("Tx: Preparing to send Disc ( SU Frame) to RX\n");
+        unsigned char discFrame[SUFrame_SIZE];
+        buildSUFrame(discFrame, A_TX, C_DISC);
+
+        int nRetransmissions = globalNRetransmissions -1;
+
+        const unsigned char *body;
+
+        disarmTimer(&linkLoop, retransmissionTimer);
+        double discSentAt = currentTimeMs();
+        
+        while (nRetransmissions >= 0) {
+            writeToSerialPort(discFrame, SUFrame_SIZE, &nRetransmissions);
+            TRACE_EVENT(EV_DISC, 0, 0, SUFrame_SIZE, globalNRetransmissions - 1 - nRetransmissions);
+            logInfo("Tx: Disc ( SU Frame ) Sent\n");
+            
+            while (timerPending(&linkLoop, retransmissionTimer)) {
+                int size = readLinkFrame(&body, TRUE);
+                if (size < 0) break;
+                if (!isSUFrame(body, size, A_RX, C_DISC)) continue;
+
+                disarmTimer(&linkLoop, retransmissionTimer);
+                recordLatency(&stats.discLatency, currentTimeMs() - discSentAt);
+                logInfo("TX: Disc received from RX.\n");
+
+                logInfo("TX: Preparring UA ( SU frame ) to finish the connection.\n");
+
+                sendSUFrame(A_TX, C_UA);
+                freeFrameReader();
+                freeEventLoop(&linkLoop);
+                
+                int isClosed = closeSerialPort();
+                if (isClosed == 0){
+                    logInfo("Tx: Connection terminated\n");
+                }
+                else{
+                    perror("Error closing SerialPort on Tx");
+                    return -1;
+                }
+
+                return 0;
+            }
+            
+            if (!timerPending(&linkLoop, retransmissionTimer)) {
+                nRetransmissions--;
+                rttBackoff();
+                logInfo("TX: Timeout or REJ! Retransmitting...\n");
+            }
+        }
+        
+        logError("TX: ERROR - Failed to establish connection after all retries.\n");
+        freeFrameReader();
+        freeEventLoop(&linkLoop);
+        closeSerialPort();
+        return -1;
+        
+    }
+    else{
+        logInfo("RX: Waiting for DISC frame...\n");
+        
+        const unsigned char *body;
+        int size;
+        
+        do {
+            size = readLinkFrame(&body, TRUE);
+            if (size < 0) break;
+        } while (!isSUFrame(body, size, A_TX, C_DISC));
+        
+        TRACE_EVENT(EV_DISC, 0, 0, SUFrame_SIZE, 0);
+        logInfo("RX: DISC received. Sending DISC...\n");
+        
+        double discSentAt = currentTimeMs();
+        if (sendSUFrame(A_RX, C_DISC) < 0) {
+            perror("writeBytesSerialPort - UA");
+            return -1;
+        }
+
+        logInfo("RX: Waiting for UA frame...\n");
+        
+        do {
+            size = readLinkFrame(&body, TRUE);
+            if (size < 0) break;
+        } while (!isSUFrame(body, size, A_TX, C_UA));
+
+        if (size >= 0) recordLatency(&stats.discLatency, currentTimeMs() - discSentAt);
+        TRACE_EVENT(EV_UA, 0, 0, SUFrame_SIZE, 0);
+        logInfo("RX: UA received. Terminating the connection...\n");
+
+        freeRxWindow();
+        freeFrameReader();
+        freeEventLoop(&linkLoop);
+
+        int isClosed = closeSerialPort();
+        if (isClosed == 0){
+            logInfo("RX: Connection terminated\n");
+        }
+        else{
+            perror("Error closing SerialPort on Tx");
+            return -1;
+        }
+
+        return 0;
+    }
+
+}
@@ -0,0 +1,31 @@
+// Link layer entry points added on top of link_layer.h (which must not change).
+
+#ifndef _LINK_LAYER_EXT_H_
+#define _LINK_LAYER_EXT_H_
+
+#include <sys/uio.h>
+
+// Largest number of blocks accepted by llwritev
+#define LL_IOV_MAX 4
+
+// Send one I-frame whose payload is the concatenation of iovcnt blocks
+// (e.g. a packet header and a slice of a mapped file). The blocks are stuffed
+// straight into the frame, without being copied into a packet first.
+// Return number of chars written, or -1 on error.
+int llwritev(const struct iovec *iov, int iovcnt);
+
+// Largest message carried by a reply frame
+#define MAX_REPLY_SIZE 256
+
+// Reply frames: the receiver answers one message of the transmitter (e.g. START).
+// Only available when both ends support them (linkConfig.replyFrames, see link_config.h).
+
+// Receiver: send bufSize bytes to the transmitter and wait until they are acknowledged.
+// Return 0 on success or -1 on error.
+int llreply(const unsigned char *buf, int bufSize);
+
+// Transmitter: wait for the receiver's reply, once every I-frame was acknowledged.
+// Return the reply size, or -1 on error or if none arrived.
+int llreadreply(unsigned char *buf);
+
+#endif // _LINK_LAYER_EXT_H_
@@ -0,0 +1,35 @@
+// Application packet types and the TLV types of control packets.
+
+#ifndef _PACKET_TYPES_H_
+#define _PACKET_TYPES_H_
+
+// Control packet types
+#define C_START 1
+#define C_DATA  2
+#define C_END   3
+#define C_DATA_COMPRESSED 4
+#define C_MANIFEST 5            // List of the files of a batch session
+#define C_DATA_AT 6             // Data packet with the file offset of its data
+#define C_DATA_COMPRESSED_AT 7  // Compressed data packet with the file offset of its data
+#define C_COPY 8                // Blocks of the receiver's old copy to place in the file (delta transfers)
+#define C_SIGNATURES 9          // Signatures of the blocks of the old copy, in a reply (delta transfers)
+
+// Data packet headers: C | L2 | L1 and C | L2 | L1 | O2 | O1 (compressed);
+// the _AT types insert an 8-byte file offset after C
+#define DATA_HEADER_SIZE 3
+#define DATA_AT_HEADER_SIZE 11
+#define MAX_DATA_HEADER_SIZE 13
+
+#define T_FILE_SIZE 0
+#define T_FILE_NAME 1
+#define T_FILE_ID   2   // CRC-32C of the size, mtime and first/last 64 KiB of the file (4 bytes),
+                        // identifies it for resuming
+#define T_OFFSET    3   // Bytes the receiver already has (8 bytes), in its reply to START
+#define T_FILE_COUNT 4  // Number of files in a batch (4 bytes), in the first manifest packet
+#define T_DIGEST    5   // XXH64 of the whole file (8 bytes), in END, also after a resume or a
+                        // delta; of the files one after the other in a batch
+#define T_DELTA     6   // The transmitter can send a delta (1 byte), in START
+#define T_BLOCK_SIZE 7  // Block size of the receiver's old copy (4 bytes), in its reply to START
+#define T_BLOCK_COUNT 8 // Number of block signatures that follow (4 bytes), in its reply to START
+
+#endif // _PACKET_TYPES_H_
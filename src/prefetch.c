@@ -0,0 +1,179 @@
+// Read-ahead implementation
+
+#include "prefetch.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef struct
+{
+    const unsigned char *data;
+    long long size;
+} Region;
+
+static Region *regions = NULL;
+static int regionCount = 0;
+static int regionCapacity = 0;
+static long long totalSize = 0;
+
+// Thread side: the region the next position is in, and where that region starts
+static int cursor = 0;
+static long long cursorStart = 0;
+
+static long long consumed = 0;      // Position of the sender
+static long long prefetched = 0;    // Everything before it was touched
+static long long pagesTouched = 0;
+static long long pagesMissing = 0;  // Pages that were not in memory (a stall avoided)
+static bool stopping = false;
+static bool running = false;
+
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t advanced = PTHREAD_COND_INITIALIZER;
+
+int addPrefetchRegion(const unsigned char *data, long long size)
+{
+    if (size <= 0) return 0;
+
+    if (regionCount == regionCapacity) {
+        int capacity = (regionCapacity > 0) ? regionCapacity * 2 : 16;
+        Region *grown = realloc(regions, capacity * sizeof(Region));
+        if (grown == NULL) return -1;
+        regions = grown;
+        regionCapacity = capacity;
+    }
+    regions[regionCount].data = data;
+    regions[regionCount].size = size;
+    regionCount++;
+    totalSize += size;
+    return 0;
+}
+
+/**
+ * @brief Brings the pages of one slice of a region into memory.
+ *
+ * madvise(MADV_WILLNEED) starts the reads for the whole slice; reading one
+ * byte per page then waits for them here instead of in the sender.
+ */
+static void touchSlice(const unsigned char *from, long long length)
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)from & ~(uintptr_t)(pageSize - 1);
+    uintptr_t end = (uintptr_t)from + length;
+    long long pages = (end - first + pageSize - 1) / pageSize;
+
+    unsigned char resident[PREFETCH_STEP / 4096 + 2];
+    bool counted = pages <= (long long)sizeof(resident) &&
+                   mincore((void *)first, end - first, resident) == 0;
+
+    madvise((void *)first, end - first, MADV_WILLNEED);
+
+    volatile unsigned char sink = 0;
+    for (long long i = 0; i < pages; i++) {
+        if (counted && !(resident[i] & 1)) pagesMissing++;
+        sink ^= *(const volatile unsigned char *)(first + i * pageSize);
+    }
+    pagesTouched += pages;
+    (void)sink;
+}
+
+/**
+ * @brief Touches the stream from position from to position to, across regions.
+ */
+static void touchRange(long long from, long long to)
+{
+    while (from < to && cursor < regionCount) {
+        long long regionEnd = cursorStart + regions[cursor].size;
+        if (from >= regionEnd) {
+            cursorStart = regionEnd;
+            cursor++;
+            continue;
+        }
+        long long sliceEnd = (to < regionEnd) ? to : regionEnd;
+        touchSlice(regions[cursor].data + (from - cursorStart), sliceEnd - from);
+        from = sliceEnd;
+    }
+}
+
+static void setAdvice(int advice)
+{
+    for (int i = 0; i < regionCount; i++) {
+        madvise((void *)regions[i].data, regions[i].size, advice);
+    }
+}
+
+/**
+ * @brief Prefetch thread: keeps the touched part PREFETCH_WINDOW bytes ahead of the sender.
+ */
+static void *prefetcher(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        long long target = consumed + PREFETCH_WINDOW;
+        if (target > totalSize) target = totalSize;
+        if (prefetched >= target) {
+            pthread_cond_wait(&advanced, &lock);
+            continue;
+        }
+
+        long long from = prefetched;
+        long long to = (from + PREFETCH_STEP < target) ? from + PREFETCH_STEP : target;
+        pthread_mutex_unlock(&lock);
+        touchRange(from, to);
+        pthread_mutex_lock(&lock);
+        prefetched = to;
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int startPrefetch(long long start)
+{
+    consumed = prefetched = start;
+    cursor = 0;
+    cursorStart = 0;
+    pagesTouched = pagesMissing = 0;
+    stopping = false;
+
+    // Page faults no longer read ahead on their own: the reads are the thread's
+    setAdvice(MADV_RANDOM);
+    if (pthread_create(&thread, NULL, prefetcher, NULL) != 0) {
+        perror("pthread_create");
+        setAdvice(MADV_SEQUENTIAL);
+        return -1;
+    }
+    running = true;
+    return 0;
+}
+
+void advancePrefetch(long long position)
+{
+    if (!running) return;
+
+    pthread_mutex_lock(&lock);
+    consumed = position;
+    if (prefetched < consumed + PREFETCH_WINDOW - PREFETCH_STEP) pthread_cond_signal(&advanced);
+    pthread_mutex_unlock(&lock);
+}
+
+void stopPrefetch()
+{
+    if (running) {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_signal(&advanced);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+        running = false;
+        printf("TX: Prefetch: %lld pages read ahead, %lld were not in memory\n", pagesTouched, pagesMissing);
+    }
+
+    free(regions);
+    regions = NULL;
+    regionCount = regionCapacity = 0;
+    totalSize = 0;
+}
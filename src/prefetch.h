@@ -0,0 +1,29 @@
+// Read-ahead for the transmitter.
+// The data packets are built straight from the mapped file(s), so a page that
+// is not in memory stalls the link while it is read from storage. A prefetch
+// thread touches the pages up to PREFETCH_WINDOW bytes ahead of the block being
+// queued, so those reads happen while earlier frames are on the line. While it
+// runs the kernel's own read-ahead on page faults is turned off (MADV_RANDOM):
+// it reads in large requests, and a page waits for its whole request.
+
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+// How far ahead of the sender the pages are brought in, and in what steps
+#define PREFETCH_WINDOW (4 << 20)
+#define PREFETCH_STEP (64 << 10)
+
+// Add a mapped region to the stream (in the order it will be sent).
+// Returns 0 on success or -1 on error.
+int addPrefetchRegion(const unsigned char *data, long long size);
+
+// Start reading ahead from stream position start. Returns 0 on success or -1 on error.
+int startPrefetch(long long start);
+
+// The sender has taken the stream up to position.
+void advancePrefetch(long long position);
+
+// Stop the thread and forget the regions.
+void stopPrefetch();
+
+#endif // _PREFETCH_H_
@@ -0,0 +1,184 @@
+// Phase profiler implementation
+
+#define _GNU_SOURCE     // RUSAGE_THREAD
+
+#include "profiler.h"
+#include "event_loop.h"
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Where the kernel publishes the id of the system call entry tracepoint
+static const char *syscallTracepoints[] = {
+    "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+    "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+};
+
+typedef struct
+{
+    double wallMs;
+    double userMs;
+    double sysMs;
+    long voluntarySwitches;
+    long involuntarySwitches;
+    uint64_t counters[PROF_COUNTERS];
+} Snapshot;
+
+bool profiling = false;
+
+static PhaseProfile phases[PROF_PHASES];
+static Snapshot started[PROF_PHASES];
+static int counterFds[PROF_COUNTERS] = {-1, -1, -1};
+
+static const char *phaseNames[PROF_PHASES] = {
+    [PROF_SETUP] = "Connection setup",
+    [PROF_TRANSFER] = "Data transfer",
+    [PROF_TEARDOWN] = "Teardown",
+    [PROF_FRAMING] = "- Framing",
+    [PROF_IO_WAIT] = "- Serial I/O wait",
+    [PROF_FILE_IO] = "- File I/O",
+};
+
+/**
+ * @brief Opens one counter of the calling thread, user and kernel time if allowed, user only otherwise.
+ *
+ * @return The file descriptor, or -1 if this counter is not available.
+ */
+static int openCounter(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_hv = 1;
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0 && type != PERF_TYPE_TRACEPOINT) {
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+/**
+ * @brief Id of the sys_enter tracepoint, or -1 if tracefs is not readable.
+ */
+static long syscallTracepointId()
+{
+    for (size_t i = 0; i < sizeof(syscallTracepoints) / sizeof(syscallTracepoints[0]); i++) {
+        FILE *file = fopen(syscallTracepoints[i], "r");
+        if (file == NULL) continue;
+        long id = -1;
+        if (fscanf(file, "%ld", &id) != 1) id = -1;
+        fclose(file);
+        if (id >= 0) return id;
+    }
+    return -1;
+}
+
+void initProfiler()
+{
+    const char *enabled = getenv("LL_PROFILE");
+    profiling = (enabled != NULL && strcmp(enabled, "1") == 0);
+    memset(phases, 0, sizeof(phases));
+    if (!profiling) return;
+
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        if (counterFds[i] >= 0) close(counterFds[i]);
+    }
+    counterFds[PROF_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counterFds[PROF_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    long tracepoint = syscallTracepointId();
+    counterFds[PROF_SYSCALLS] = (tracepoint >= 0) ? openCounter(PERF_TYPE_TRACEPOINT, tracepoint) : -1;
+}
+
+static void takeSnapshot(Snapshot *snapshot, bool allThreads)
+{
+    struct rusage usage;
+    getrusage(allThreads ? RUSAGE_SELF : RUSAGE_THREAD, &usage);
+
+    snapshot->wallMs = currentTimeMs();
+    snapshot->userMs = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0;
+    snapshot->sysMs = usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+    snapshot->voluntarySwitches = usage.ru_nvcsw;
+    snapshot->involuntarySwitches = usage.ru_nivcsw;
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        uint64_t value = 0;
+        if (counterFds[i] >= 0 && read(counterFds[i], &value, sizeof(value)) != sizeof(value)) value = 0;
+        snapshot->counters[i] = value;
+    }
+}
+
+void profileBegin(ProfilePhase phase)
+{
+    takeSnapshot(&started[phase], phase < PROF_FIRST_INNER);
+}
+
+void profileEnd(ProfilePhase phase)
+{
+    Snapshot now;
+    takeSnapshot(&now, phase < PROF_FIRST_INNER);
+
+    PhaseProfile *profile = &phases[phase];
+    const Snapshot *start = &started[phase];
+    profile->calls++;
+    profile->wallMs += now.wallMs - start->wallMs;
+    profile->userMs += now.userMs - start->userMs;
+    profile->sysMs += now.sysMs - start->sysMs;
+    profile->voluntarySwitches += now.voluntarySwitches - start->voluntarySwitches;
+    profile->involuntarySwitches += now.involuntarySwitches - start->involuntarySwitches;
+    for (int i = 0; i < PROF_COUNTERS; i++) profile->counters[i] += now.counters[i] - start->counters[i];
+}
+
+const PhaseProfile *phaseProfile(ProfilePhase phase)
+{
+    return &phases[phase];
+}
+
+bool profileCounterAvailable(ProfileCounter counter)
+{
+    return counterFds[counter] >= 0;
+}
+
+static void printCounter(const PhaseProfile *profile, ProfileCounter counter)
+{
+    if (counterFds[counter] >= 0) printf(" %13llu", (unsigned long long)profile->counters[counter]);
+    else printf(" %13s", "-");
+}
+
+void printProfile(long long bytes)
+{
+    printf("\nPROFILE (CPU of all threads for the connection phases, of the main thread inside the transfer):\n");
+    printf("  %-20s %7s %10s %9s %9s %13s %13s %13s %11s\n", "Phase", "Calls", "Wall ms", "User ms", "Sys ms",
+           "Cycles", "Instructions", "Syscalls", "Ctx sw v/i");
+    for (int phase = 0; phase < PROF_PHASES; phase++) {
+        const PhaseProfile *profile = &phases[phase];
+        if (profile->calls == 0) continue;
+        printf("  %-20s %7lld %10.1f %9.1f %9.1f", phaseNames[phase], profile->calls, profile->wallMs,
+               profile->userMs, profile->sysMs);
+        printCounter(profile, PROF_CYCLES);
+        printCounter(profile, PROF_INSTRUCTIONS);
+        printCounter(profile, PROF_SYSCALLS);
+        printf(" %5ld/%-5ld\n", profile->voluntarySwitches, profile->involuntarySwitches);
+    }
+
+    const PhaseProfile *transfer = &phases[PROF_TRANSFER];
+    if (bytes > 0 && transfer->calls > 0) {
+        printf("  Per transferred byte: CPU %.1f ns (user %.1f, sys %.1f)",
+               (transfer->userMs + transfer->sysMs) * 1e6 / bytes, transfer->userMs * 1e6 / bytes,
+               transfer->sysMs * 1e6 / bytes);
+        if (counterFds[PROF_CYCLES] >= 0) printf(", %.1f cycles", (double)transfer->counters[PROF_CYCLES] / bytes);
+        if (counterFds[PROF_INSTRUCTIONS] >= 0) {
+            printf(", %.1f instructions", (double)transfer->counters[PROF_INSTRUCTIONS] / bytes);
+        }
+        printf("\n");
+    }
+    if (counterFds[PROF_CYCLES] < 0 || counterFds[PROF_SYSCALLS] < 0) {
+        printf("  (\"-\": perf_event counter not available here; see /proc/sys/kernel/perf_event_paranoid)\n");
+    }
+}
@@ -0,0 +1,76 @@
+// Phase profiler (LL_PROFILE=1).
+// Measures, for each phase, the monotonic wall time, the user and system CPU
+// time (getrusage), the context switches and, where perf_event_open is allowed
+// (perf_event_paranoid, a PMU in the machine or VM), the cycles, instructions and
+// system calls of the main thread. The connection phases (setup, transfer,
+// teardown) count the CPU of every thread (compression, prefetch, writer); the
+// phases inside the transfer (framing, serial I/O wait, file I/O) only that of
+// the main thread, which runs the protocol. The report ends with the CPU cost
+// per transferred byte.
+//
+// Each measurement costs two or three system calls, so only the phases are
+// measured, never single bytes; with LL_PROFILE unset a phase costs one test.
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    PROF_SETUP,         // llopen
+    PROF_TRANSFER,      // From the connection established to the END packet
+    PROF_TEARDOWN,      // llclose
+    PROF_FRAMING,       // Building I-frames and checking the ones received (stuffing, FCS)
+    PROF_IO_WAIT,       // Waiting for the serial port: frames to arrive, writes to complete
+    PROF_FILE_IO,       // File data on the main thread: digest, writer queue, read-back
+    PROF_PHASES
+} ProfilePhase;
+
+// First phase measured on the main thread only
+#define PROF_FIRST_INNER PROF_FRAMING
+
+// perf_event counters, when available
+typedef enum
+{
+    PROF_CYCLES,
+    PROF_INSTRUCTIONS,
+    PROF_SYSCALLS,
+    PROF_COUNTERS
+} ProfileCounter;
+
+typedef struct
+{
+    long long calls;
+    double wallMs;
+    double userMs;
+    double sysMs;
+    long voluntarySwitches;     // Blocked (I/O, locks)
+    long involuntarySwitches;   // Preempted
+    uint64_t counters[PROF_COUNTERS];
+} PhaseProfile;
+
+// Set by initProfiler when LL_PROFILE=1
+extern bool profiling;
+
+// Read LL_PROFILE, clear the phases and open the perf_event counters that are allowed.
+void initProfiler();
+
+// Start and end one measurement of a phase (phases may nest, a phase may not).
+void profileBegin(ProfilePhase phase);
+void profileEnd(ProfilePhase phase);
+
+// Totals of a phase so far.
+const PhaseProfile *phaseProfile(ProfilePhase phase);
+
+// Whether a counter could be opened.
+bool profileCounterAvailable(ProfileCounter counter);
+
+// Print the table of phases and the cost per byte of bytes transferred.
+void printProfile(long long bytes);
+
+#define PROFILE_BEGIN(phase) do { if (profiling) profileBegin(phase); } while (0)
+#define PROFILE_END(phase) do { if (profiling) profileEnd(phase); } while (0)
+
+#endif // _PROFILER_H_
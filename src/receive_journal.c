@@ -0,0 +1,214 @@
+// Receive journal implementation
+
+#include "receive_journal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "LLJRNL1"
+
+typedef struct
+{
+    char magic[8];
+    long long fileSize;
+    uint32_t fileId;
+    uint32_t reserved;
+    long long committed;    // Bytes of the file known to be on disk
+} JournalRecord;
+
+static int journalFd = -1;
+static char journalPath[300];
+static JournalRecord record;
+static FILE *journalFile = NULL;   // The file being received
+static double lastCommitMs = 0;
+
+// Data written past the first gap (out-of-order blocks), sorted by start.
+// Ranges that do not fit are forgotten: they are just sent again on resume.
+#define MAX_PENDING_RANGES 64
+typedef struct
+{
+    long long start;
+    long long end;
+} Range;
+static long long prefix = 0;        // Bytes [0, prefix) are all written
+static Range pending[MAX_PENDING_RANGES];
+static int pendingCount = 0;
+
+static double monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Writes the record over the previous one (a single small write).
+ */
+static int writeRecord()
+{
+    if (pwrite(journalFd, &record, sizeof(record), 0) != sizeof(record)) {
+        perror("journal write");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the output file, keeping the bytes a previous transfer committed.
+ *
+ * The previous data is only kept if the journal describes the same file
+ * (same size and identity) and the partial file still has the committed bytes;
+ * anything after them is truncated. Otherwise the file is created empty.
+ *
+ * @param filename Name of the file to receive.
+ * @param fileSize Size announced in START.
+ * @param fileId Identity of the file (see T_FILE_ID), announced in START.
+ * @param file Receives the open file, positioned where the data continues.
+ * @param resumeOffset Receives the number of bytes kept.
+ * @return 0 on success, -1 on error.
+ */
+int openJournal(const char *filename, long long fileSize, uint32_t fileId,
+                FILE **file, long long *resumeOffset)
+{
+    snprintf(journalPath, sizeof(journalPath), "%s.journal", filename);
+    journalFd = open(journalPath, O_RDWR | O_CREAT, 0644);
+    if (journalFd < 0) {
+        perror("journal open");
+        return -1;
+    }
+
+    JournalRecord previous;
+    struct stat st;
+    *resumeOffset = 0;
+    if (pread(journalFd, &previous, sizeof(previous), 0) == sizeof(previous) &&
+        memcmp(previous.magic, JOURNAL_MAGIC, sizeof(previous.magic)) == 0 &&
+        previous.fileSize == fileSize && previous.fileId == fileId &&
+        stat(filename, &st) == 0 && st.st_size >= previous.committed) {
+        *resumeOffset = previous.committed;
+    }
+
+    *file = fopen(filename, (*resumeOffset > 0) ? "r+b" : "wb");
+    if (*file == NULL) {
+        perror("fopen");
+        close(journalFd);
+        journalFd = -1;
+        return -1;
+    }
+    if (*resumeOffset > 0 &&
+        (ftruncate(fileno(*file), *resumeOffset) < 0 || fseeko(*file, *resumeOffset, SEEK_SET) < 0)) {
+        perror("journal resume");
+        fclose(*file);
+        close(journalFd);
+        journalFd = -1;
+        return -1;
+    }
+
+    memset(&record, 0, sizeof(record));
+    memcpy(record.magic, JOURNAL_MAGIC, sizeof(record.magic));
+    record.fileSize = fileSize;
+    record.fileId = fileId;
+    record.committed = *resumeOffset;
+    prefix = *resumeOffset;
+    pendingCount = 0;
+    journalFile = *file;
+    lastCommitMs = monotonicMs();
+    return writeRecord();
+}
+
+bool hasJournal(const char *filename)
+{
+    char path[sizeof(journalPath)];
+    snprintf(path, sizeof(path), "%s.journal", filename);
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * @brief Commits the received bytes: the data reaches the disk before the journal says so.
+ *
+ * @param offset Bytes of the file written so far.
+ * @param force Commit even if JOURNAL_COMMIT_BYTES / JOURNAL_COMMIT_MS did not pass.
+ */
+int commitJournal(long long offset, bool force)
+{
+    if (journalFd < 0 || offset == record.committed) return 0;
+
+    double now = monotonicMs();
+    if (!force && offset - record.committed < JOURNAL_COMMIT_BYTES && now - lastCommitMs < JOURNAL_COMMIT_MS) {
+        return 0;
+    }
+
+    if (fflush(journalFile) != 0 || fdatasync(fileno(journalFile)) < 0) {
+        perror("journal sync");
+        return -1;
+    }
+    record.committed = offset;
+    lastCommitMs = now;
+    return writeRecord();
+}
+
+void closeJournal(bool complete)
+{
+    if (journalFd < 0) return;
+    close(journalFd);
+    journalFd = -1;
+    journalFile = NULL;
+    if (complete) unlink(journalPath);
+}
+
+/**
+ * @brief Forgets the committed bytes: they are not what the transmitter sent.
+ *
+ * The journal is deleted; if that fails it is left saying that nothing is
+ * committed, so a later transfer still starts from the first byte.
+ */
+void discardJournal()
+{
+    if (journalFd < 0) return;
+    if (unlink(journalPath) < 0) {
+        record.committed = 0;
+        writeRecord();
+    }
+    close(journalFd);
+    journalFd = -1;
+    journalFile = NULL;
+}
+
+/**
+ * @brief Adds a written range; the prefix grows over the ranges it now reaches.
+ */
+long long markWritten(long long offset, long long size)
+{
+    long long end = offset + size;
+
+    if (offset <= prefix) {
+        if (end > prefix) prefix = end;
+    } else if (pendingCount < MAX_PENDING_RANGES) {
+        int i = pendingCount;
+        while (i > 0 && pending[i - 1].start > offset) {
+            pending[i] = pending[i - 1];
+            i--;
+        }
+        pending[i].start = offset;
+        pending[i].end = end;
+        pendingCount++;
+    }
+
+    int absorbed = 0;
+    while (absorbed < pendingCount && pending[absorbed].start <= prefix) {
+        if (pending[absorbed].end > prefix) prefix = pending[absorbed].end;
+        absorbed++;
+    }
+    if (absorbed > 0) {
+        memmove(pending, pending + absorbed, (pendingCount - absorbed) * sizeof(Range));
+        pendingCount -= absorbed;
+    }
+    return prefix;
+}
+
+long long writtenPrefix()
+{
+    return prefix;
+}
@@ -0,0 +1,46 @@
+// Receive journal for resumable transfers.
+// Next to the file being received, "<name>.journal" records the identity of
+// the file (size and identity sent in START) and how many bytes of it are
+// safely on disk. A later transfer of the same file starts from there; the
+// journal is removed once the file is complete.
+
+#ifndef _RECEIVE_JOURNAL_H_
+#define _RECEIVE_JOURNAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The data is flushed to disk and the journal updated after this many bytes
+// or this many milliseconds, whichever comes first
+#define JOURNAL_COMMIT_BYTES (1 << 20)
+#define JOURNAL_COMMIT_MS 1000
+
+// Open the output file for a transfer, resuming it if the journal matches.
+// Sets *file (positioned at the end of the kept data) and *resumeOffset.
+// Returns 0 on success or -1 on error.
+int openJournal(const char *filename, long long fileSize, uint32_t fileId,
+                FILE **file, long long *resumeOffset);
+
+// TRUE if a journal of an unfinished transfer is next to filename.
+bool hasJournal(const char *filename);
+
+// Record that the first offset bytes were received, if a commit is due
+// (force to commit now). Returns 0 on success or -1 on error.
+int commitJournal(long long offset, bool force);
+
+// Close the journal; deleted if the transfer is complete.
+void closeJournal(bool complete);
+
+// Close and delete the journal of a file that failed its end-to-end check,
+// so the next transfer starts over instead of keeping the bad data.
+void discardJournal();
+
+// Record that size bytes were written at offset, in any order. Returns how many
+// bytes from the start of the file are now all written (what can be committed).
+long long markWritten(long long offset, long long size);
+
+// Bytes from the start of the file that are all written.
+long long writtenPrefix();
+
+#endif // _RECEIVE_JOURNAL_H_
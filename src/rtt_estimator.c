@@ -0,0 +1,77 @@
+// Round-trip time estimator implementation
+
+#include "rtt_estimator.h"
+#include "statistics.h"
+#include <stdbool.h>
+
+static double srtt = 0;        // Smoothed RTT (ms)
+static double rttVar = 0;      // Mean deviation of the RTT (ms)
+static int rto = 0;            // Current timeout, including backoff (ms)
+static bool haveSample = false;
+
+/**
+ * @brief Keeps the RTO inside [MIN_RTO_MS, MAX_RTO_MS] and publishes it in stats.
+ */
+static void setRto(double value)
+{
+    if (value < MIN_RTO_MS) value = MIN_RTO_MS;
+    if (value > MAX_RTO_MS) value = MAX_RTO_MS;
+    rto = (int)value;
+    stats.rtoMs = rto;
+}
+
+/**
+ * @brief Resets the estimator. Until the first sample the RTO is initialRtoMs.
+ */
+void initRttEstimator(int initialRtoMs)
+{
+    srtt = 0;
+    rttVar = 0;
+    haveSample = false;
+    setRto(initialRtoMs);
+}
+
+/**
+ * @brief Updates SRTT/RTTVAR with a new measurement and recomputes the RTO.
+ *
+ * The first sample initialises SRTT = R and RTTVAR = R / 2. A sample also
+ * cancels any backoff in effect.
+ *
+ * @param rttMs Measured round trip in milliseconds.
+ */
+void rttSample(double rttMs)
+{
+    if (rttMs < 0) rttMs = 0;
+
+    if (!haveSample) {
+        srtt = rttMs;
+        rttVar = rttMs / 2;
+        haveSample = true;
+    } else {
+        double delta = srtt - rttMs;
+        if (delta < 0) delta = -delta;
+        rttVar = 0.75 * rttVar + 0.25 * delta;
+        srtt = 0.875 * srtt + 0.125 * rttMs;
+    }
+
+    double variation = 4 * rttVar;
+    if (variation < RTT_GRANULARITY_MS) variation = RTT_GRANULARITY_MS;
+    setRto(srtt + variation);
+
+    stats.rttSamples++;
+    stats.srttMs = srtt;
+    stats.rttVarMs = rttVar;
+}
+
+/**
+ * @brief Exponential backoff after a timeout.
+ */
+void rttBackoff()
+{
+    setRto(2.0 * rto);
+}
+
+int rttTimeoutMs()
+{
+    return rto;
+}
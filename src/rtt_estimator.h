@@ -0,0 +1,32 @@
+// Round-trip time estimator for the retransmission timer.
+// Keeps a smoothed RTT and its mean deviation (Jacobson/Karels) and derives the
+// retransmission timeout (RTO) from them, in milliseconds:
+//   RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+//   SRTT   = 7/8 SRTT + 1/8 R
+//   RTO    = SRTT + max(RTT_GRANULARITY_MS, 4 * RTTVAR)
+// Each timeout doubles the RTO until a new sample is taken. Samples must not be
+// taken from retransmitted frames (Karn's rule); that is up to the caller.
+
+#ifndef _RTT_ESTIMATOR_H_
+#define _RTT_ESTIMATOR_H_
+
+// Bounds of the RTO
+#define MIN_RTO_MS 100
+#define MAX_RTO_MS 60000
+
+// Clock granularity used in the RTO formula
+#define RTT_GRANULARITY_MS 1
+
+// Forget previous samples and start with initialRtoMs (the configured timeout).
+void initRttEstimator(int initialRtoMs);
+
+// Feed one round-trip measurement, in milliseconds.
+void rttSample(double rttMs);
+
+// Double the RTO after a timeout (bounded by MAX_RTO_MS).
+void rttBackoff();
+
+// Current retransmission timeout in milliseconds.
+int rttTimeoutMs();
+
+#endif // _RTT_ESTIMATOR_H_
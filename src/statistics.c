@@ -1,8 +1,15 @@
 #include "statistics.h"
+#include "stats_export.h"
+#include "link_config.h"
+#include "profiler.h"
+#include "stats_shm.h"
 #include <stdio.h>
 #include <string.h>
 #include <sys/time.h>
 
+// Bits on the line per byte: start bit, 8 data bits, stop bit
+#define LINE_BITS_PER_BYTE 10
+
 Statistics stats;
 /**
  * @brief Initializes the global statistics structure.
@@ -12,11 +19,43 @@ Statistics stats;
  */
 void initStatistics() {
     memset(&stats, 0, sizeof(Statistics));
+    initStatsExport();
+    initProfiler();
     
     struct timeval tv;
     gettimeofday(&tv, NULL);
     stats.startTime = tv.tv_sec + tv.tv_usec / 1000000.0;
 }
+
+/**
+ * @brief Restarts the transfer time, once the connection is established.
+ *
+ * The statistics are initialized before llopen so the SET/UA exchange is
+ * counted, but the throughput only covers the transfer itself.
+ */
+void markTransferStart() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    stats.startTime = tv.tv_sec + tv.tv_usec / 1000000.0;
+    startStatsSeries();
+    PROFILE_BEGIN(PROF_TRANSFER);
+    setLiveState(LIVE_TRANSFER);
+}
+
+/**
+ * @brief Records the end of the transfer, before llclose.
+ *
+ * printStatistics is called after llclose (to include the DISC exchange) and
+ * uses this time instead of its own.
+ */
+void markTransferEnd() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    stats.endTime = tv.tv_sec + tv.tv_usec / 1000000.0;
+    endStatsSeries();
+    PROFILE_END(PROF_TRANSFER);
+    setLiveState(LIVE_CLOSING);
+}
 /**
  * @brief Calculates the data transfer throughput.
  *
@@ -49,18 +88,106 @@ double calculateFER() {
     return (double)totalErrorFrames / totalFramesReceived;
 }
 
+/**
+ * @brief Efficiency predicted by the textbook ARQ models for the mode in use.
+ *
+ * With a = Tprop / Tf: Stop-and-Wait gives S = (1 - Pe) / (1 + 2a), i.e.
+ * Tf / (Tf + 2 Tprop) (1 - Pe). A window W that covers 1 + 2a frames keeps the
+ * line busy, leaving 1 - Pe (Selective Repeat) or (1 - Pe) / (1 + 2a Pe) (Go-Back-N,
+ * which resends the whole window); a smaller one is limited by W / (1 + 2a).
+ */
+static double theoreticalEfficiency(ArqMode mode, int window, double a, double pe)
+{
+    if (mode == ARQ_STOP_AND_WAIT || window <= 1) return (1 - pe) / (1 + 2 * a);
+
+    bool fullWindow = window >= 1 + 2 * a;
+    if (mode == ARQ_SELECTIVE_REPEAT) return fullWindow ? 1 - pe : window * (1 - pe) / (1 + 2 * a);
+    return fullWindow ? (1 - pe) / (1 + 2 * a * pe) : window * (1 - pe) / ((1 + 2 * a) * (1 - pe + window * pe));
+}
+
+/**
+ * @brief Prints one share of the line time (capacity bits over the transfer).
+ */
+static void printLineShare(const char *name, long long bytes, double bits, double capacity)
+{
+    if (bytes >= 0) printf("    - %s: %lld bytes, %.1f%%\n", name, bytes, bits * 100.0 / capacity);
+    else printf("    - %s: %.1f%%\n", name, bits * 100.0 / capacity);
+}
+
+/**
+ * @brief Where the line time went, and the measured efficiency against the ARQ model.
+ *
+ * The line can carry baudRate bits per second over the transfer. Every byte
+ * written takes LINE_BITS_PER_BYTE of them: 8 are payload, header, stuffing, FCS,
+ * S/U frames or copies sent again, 2 are start and stop bits. The rest of the
+ * time the line was idle. The shares add up to 100%.
+ */
+static void printLineUsage(double throughput)
+{
+    double elapsed = stats.endTime - stats.startTime;
+    if (stats.wireBytes == 0 || stats.baudRate <= 0 || elapsed <= 0) return;
+
+    double capacity = elapsed * stats.baudRate;
+    long long control = stats.wireBytes - stats.wirePayloadBytes - stats.wireHeaderBytes - stats.wireStuffingBytes -
+                        stats.wireFcsBytes - stats.wireRetransmittedBytes;
+    double busyBits = stats.wireBytes * (double)LINE_BITS_PER_BYTE;
+    double idleBits = (capacity > busyBits) ? capacity - busyBits : 0;
+    double idleS = idleBits / stats.baudRate;
+    double ackWaitS = stats.ackWaitMs / 1000.0;
+
+    printf("\nLINE USAGE (%d baud over %.3f s):\n", stats.baudRate, elapsed);
+    printf("  Bytes written: %lld\n", stats.wireBytes);
+    printLineShare("I-frame payload", stats.wirePayloadBytes, stats.wirePayloadBytes * 8.0, capacity);
+    printLineShare("Frame headers and flags", stats.wireHeaderBytes, stats.wireHeaderBytes * 8.0, capacity);
+    printLineShare("Byte stuffing escapes", stats.wireStuffingBytes, stats.wireStuffingBytes * 8.0, capacity);
+    printLineShare("FCS (BCC2/CRC)", stats.wireFcsBytes, stats.wireFcsBytes * 8.0, capacity);
+    printLineShare("S/U frames", control, control * 8.0, capacity);
+    printLineShare("Retransmitted I-frames", stats.wireRetransmittedBytes, stats.wireRetransmittedBytes * 8.0, capacity);
+    printLineShare("Start and stop bits", -1, busyBits - stats.wireBytes * 8.0, capacity);
+    printLineShare("Idle", -1, idleBits, capacity);
+    printf("  Transmitting %.3f s, idle %.3f s", busyBits / stats.baudRate, idleS);
+    if (ackWaitS > 0) printf(" (%.3f s of it waiting for acknowledgements)", ackWaitS < idleS ? ackWaitS : idleS);
+    printf("\n");
+
+    // The model needs I-frames sent and an RTT, i.e. the transmitter
+    if (stats.framesTransmitted == 0 || stats.rttSamples == 0) return;
+
+    long long firstCopies = stats.wirePayloadBytes + stats.wireHeaderBytes + stats.wireStuffingBytes + stats.wireFcsBytes;
+    double frameS = (double)firstCopies / stats.framesTransmitted * LINE_BITS_PER_BYTE / stats.baudRate;
+    // The SRTT runs from the end of the I-frame to the RR, which takes a 5-byte frame on the line
+    double propS = (stats.srttMs / 1000.0 - 5.0 * LINE_BITS_PER_BYTE / stats.baudRate) / 2;
+    if (propS < 0) propS = 0;
+    double a = propS / frameS;
+    double pe = (double)(stats.rejReceived + stats.timeouts) / (stats.framesTransmitted + stats.framesRetransmitted);
+    static const char *modes[] = {"Stop-and-Wait", "Go-Back-N", "Selective Repeat"};
+    double theoretical = theoreticalEfficiency(linkConfig.arqMode, linkConfig.windowSize, a, pe);
+    double measured = throughput / stats.baudRate;
+
+    double overhead = (stats.wireHeaderBytes + stats.wireStuffingBytes + stats.wireFcsBytes + control) * 8.0 +
+                      (busyBits - stats.wireBytes * 8.0);
+    double errors = stats.wireRetransmittedBytes * 8.0;
+    const char *largest = (overhead >= errors && overhead >= idleBits) ? "overhead (framing, start/stop bits)"
+                        : (errors >= idleBits) ? "errors (retransmissions)" : "latency (idle line)";
+
+    printf("\nEFFICIENCY MODEL (%s, window %d):\n", modes[linkConfig.arqMode], linkConfig.windowSize);
+    printf("  Tf = %.3f ms (mean I-frame), Tprop = %.3f ms ((SRTT - RR time) / 2), a = %.4f\n",
+           frameS * 1000, propS * 1000, a);
+    printf("  Pe = %.4f ((REJ received + timeouts) / I-frames sent)\n", pe);
+    printf("  Theoretical S: %.4f\n", theoretical);
+    printf("  Measured S = R / C: %.4f\n", measured);
+    printf("  Gap: %.4f, largest loss: %s\n", theoretical - measured, largest);
+}
+
 /**
  * @brief Calculates final metrics and prints a formatted report to stdout.
  *
- * Records the end time, calculates throughput, FER, and presents frame, error,
+ * Records the end time (unless markTransferEnd did), calculates throughput, FER, and presents frame, error,
  * and retransmission statistics.
  *
  * @param role The role string ("TRANSMITTER" or "RECEIVER") for the report title.
  */
 void printStatistics(const char* role) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    stats.endTime = tv.tv_sec + tv.tv_usec / 1000000.0;
+    if (stats.endTime == 0) markTransferEnd();
     
     double throughput = calculateThroughput();
     double fer = calculateFER();
@@ -71,6 +198,10 @@ void printStatistics(const char* role) {
     
     printf("DATA TRANSFER:\n");
     printf("  Total data bytes: %lld\n", stats.totalDataBytes);
+    if (stats.filesTransferred > 0) {
+        printf("  Files: %d (%d data packets shared by several files)\n",
+               stats.filesTransferred, stats.packetsShared);
+    }
     printf("  Transfer time: %.3f seconds\n", stats.endTime - stats.startTime);
     printf("  Throughput: %.2f bits/s (%.2f KB/s)\n", 
            throughput, 
@@ -109,5 +240,47 @@ void printStatistics(const char* role) {
                (stats.framesRetransmitted * 100.0) / stats.framesTransmitted);
     }
 
+    if (stats.compressionThreads > 0 || stats.packetsCompressed > 0) {
+        printf("\nCOMPRESSION:\n");
+        if (stats.compressionThreads > 0) printf("  Worker threads: %d\n", stats.compressionThreads);
+        printf("  Packets compressed: %d\n", stats.packetsCompressed);
+        printf("  Bytes in data packets: %lld\n", stats.payloadBytes);
+        if (stats.payloadBytes > 0) {
+            printf("  Compression ratio: %.2f (file bytes / bytes in data packets)\n",
+                   (double)stats.totalDataBytes / stats.payloadBytes);
+        }
+        printf("  Effective goodput: %.2f bits/s of file data (%.2f bits/s of packet data)\n",
+               throughput, throughput * stats.payloadBytes / (stats.totalDataBytes > 0 ? stats.totalDataBytes : 1));
+    }
+
+    if (stats.deltaBlocks > 0) {
+        printf("\nDELTA TRANSFER:\n");
+        printf("  Blocks in the receiver's copy: %d\n", stats.deltaBlocks);
+        printf("  Reused from it: %lld bytes (%.1f%%)\n", stats.deltaReusedBytes,
+               stats.totalDataBytes > 0 ? stats.deltaReusedBytes * 100.0 / stats.totalDataBytes : 0.0);
+        printf("  Sent in data packets: %lld bytes\n", stats.totalDataBytes - stats.deltaReusedBytes);
+    }
+
+    if (stats.rtoMs > 0) {
+        printf("\nRETRANSMISSION TIMER:\n");
+        printf("  RTT samples: %d\n", stats.rttSamples);
+        printf("  Smoothed RTT: %.1f ms (deviation %.1f ms)\n", stats.srttMs, stats.rttVarMs);
+        printf("  RTO: %d ms\n", stats.rtoMs);
+    }
+
+    printLineUsage(throughput);
+
+    if (stats.ackLatency.samples > 0 || stats.setLatency.samples > 0 || stats.discLatency.samples > 0) {
+        printf("\nLATENCY (first copy sent -> answer):\n");
+        printLatency("I-frame -> RR/REJ", &stats.ackLatency);
+        printLatency("SET -> UA", &stats.setLatency);
+        printLatency(strcmp(role, "TRANSMITTER") == 0 ? "DISC -> DISC" : "DISC -> UA", &stats.discLatency);
+    }
+
+    if (profiling) printProfile(stats.totalDataBytes);
+
     printf("\n========================================\n\n");
+
+    exportStatistics(role);
+    setLiveState(LIVE_DONE);
 }
\ No newline at end of file
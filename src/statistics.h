@@ -1,11 +1,15 @@
 #ifndef STATISTICS_H
 #define STATISTICS_H
 
+#include "latency_histogram.h"
+
 typedef struct {
     // Number of frames sent
     int framesTransmitted;
     // Number of frames received correctly
     int framesReceivedCorrectly;
+    // Payload bytes of new I-frames sent (transmitter) or of I-frames received correctly (receiver)
+    long long iFrameBytes;
     
     // Retransmissions and timeouts
     int framesRetransmitted;
@@ -20,9 +24,55 @@ typedef struct {
     int bcc1Errors;
     int bcc2Errors;
     
+    // Retransmission timer (transmitter): RTT estimate and current timeout
+    int rttSamples;
+    double srttMs;
+    double rttVarMs;
+    int rtoMs;
+
+    // Time from the first copy of a frame sent to its answer (retransmissions included):
+    // I-frames and replies to their RR/REJ, SET to UA, DISC to DISC (transmitter) or UA (receiver)
+    LatencyHistogram ackLatency;
+    LatencyHistogram setLatency;
+    LatencyHistogram discLatency;
+    
     // Useful data bytes
     long long totalDataBytes;
     
+    // Data packets: bytes carried in them (after compression) and compressed packets
+    long long payloadBytes;
+    int packetsCompressed;
+    long long compressedInputBytes;
+    int compressionThreads;
+
+    // Batch sessions: files sent and data packets holding bytes of several files
+    int filesTransferred;
+    int packetsShared;
+
+    // Delta transfers: blocks of the receiver's old copy, and the file bytes taken from it
+    int deltaBlocks;
+    long long deltaReusedBytes;
+    
+    // Bytes written to the line. First copies of I-frames are split into payload, header
+    // (F, A, C, BCC1, closing F), stuffing escapes and FCS; every copy sent again counts as
+    // retransmitted; the rest are S and U frames (RR, REJ, SET, UA, DISC)
+    long long wireBytes;
+    long long wirePayloadBytes;
+    long long wireHeaderBytes;
+    long long wireStuffingBytes;
+    long long wireFcsBytes;
+    long long wireRetransmittedBytes;
+
+    // Transmitter blocked on a full window (or flushing it) after the line sent everything
+    double ackWaitMs;
+
+    // File bytes sent or received so far, and the size of the file(s), for live monitors
+    long long progressBytes;
+    long long progressTotal;
+
+    // Line speed, for the efficiency (throughput / baud rate) of the export
+    int baudRate;
+    
     // Timing for throughput calculation
     double startTime;
     double endTime;
@@ -34,6 +84,8 @@ extern Statistics stats;
 
 // Helper functions
 void initStatistics();
+void markTransferStart();
+void markTransferEnd();
 void printStatistics(const char* role);
 double calculateThroughput();
 double calculateFER();
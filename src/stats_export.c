@@ -0,0 +1,316 @@
+// Statistics export implementation
+
+#include "stats_export.h"
+#include "statistics.h"
+#include "profiler.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Most fields exported (one per column of the CSV)
+#define MAX_FIELDS 96
+
+typedef struct
+{
+    const char *name;
+    bool integer;
+    long long count;    // When integer
+    double value;
+} Field;
+
+// Counters at one instant of the transfer
+typedef struct
+{
+    double t;           // Seconds since stats.startTime
+    long long bytes;    // stats.iFrameBytes
+    int frames;
+    int retransmitted;
+    int timeouts;
+    int rej;            // Sent and received
+    int errors;         // BCC1 and BCC2
+} Sample;
+
+static const char *exportPath = NULL;
+static int intervalMs = 0;
+static Sample *samples = NULL;
+static int sampleCount = 0;
+static int sampleCapacity = 0;
+
+void initStatsExport()
+{
+    const char *path = getenv("LL_STATS_FILE");
+    const char *interval = getenv("LL_STATS_INTERVAL");
+
+    exportPath = (path != NULL && path[0] != '\0') ? path : NULL;
+    intervalMs = 0;
+    sampleCount = 0;
+
+    if (interval != NULL) {
+        intervalMs = atoi(interval);
+        if (intervalMs < MIN_STATS_INTERVAL_MS) {
+            printf("STATS: LL_STATS_INTERVAL must be at least %d ms, no time series\n", MIN_STATS_INTERVAL_MS);
+            intervalMs = 0;
+        } else if (exportPath == NULL) {
+            printf("STATS: LL_STATS_INTERVAL without LL_STATS_FILE, no time series\n");
+            intervalMs = 0;
+        }
+    }
+}
+
+int statsSampleIntervalMs()
+{
+    return intervalMs;
+}
+
+static void addSample(double t)
+{
+    if (sampleCount == sampleCapacity) {
+        int capacity = (sampleCapacity > 0) ? sampleCapacity * 2 : 256;
+        Sample *grown = realloc(samples, capacity * sizeof(Sample));
+        if (grown == NULL) return;
+        samples = grown;
+        sampleCapacity = capacity;
+    }
+
+    Sample *sample = &samples[sampleCount++];
+    sample->t = t;
+    sample->bytes = stats.iFrameBytes;
+    sample->frames = stats.framesTransmitted;
+    sample->retransmitted = stats.framesRetransmitted;
+    sample->timeouts = stats.timeouts;
+    sample->rej = stats.rejSent + stats.rejReceived;
+    sample->errors = stats.bcc1Errors + stats.bcc2Errors;
+}
+
+void startStatsSeries()
+{
+    sampleCount = 0;
+    if (intervalMs > 0) addSample(0);
+}
+
+void sampleStatistics()
+{
+    if (intervalMs == 0 || stats.endTime != 0) return;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    addSample(tv.tv_sec + tv.tv_usec / 1000000.0 - stats.startTime);
+}
+
+void endStatsSeries()
+{
+    if (intervalMs > 0) addSample(stats.endTime - stats.startTime);
+}
+
+/**
+ * @brief Throughput of the payload bytes between sample i - 1 and sample i (bits/s).
+ */
+static double intervalThroughput(int i)
+{
+    if (i == 0) return 0;
+    double elapsed = samples[i].t - samples[i - 1].t;
+    return (elapsed > 0) ? (samples[i].bytes - samples[i - 1].bytes) * 8.0 / elapsed : 0;
+}
+
+static void addCount(Field *fields, int *n, const char *name, long long count)
+{
+    if (*n < MAX_FIELDS) fields[(*n)++] = (Field){.name = name, .integer = true, .count = count};
+}
+
+static void addValue(Field *fields, int *n, const char *name, double value)
+{
+    if (*n < MAX_FIELDS) fields[(*n)++] = (Field){.name = name, .integer = false, .value = value};
+}
+
+static void addLatency(Field *fields, int *n, const char *names[5], const LatencyHistogram *histogram)
+{
+    addCount(fields, n, names[0], histogram->samples);
+    addValue(fields, n, names[1], latencyPercentile(histogram, 50));
+    addValue(fields, n, names[2], latencyPercentile(histogram, 90));
+    addValue(fields, n, names[3], latencyPercentile(histogram, 99));
+    addValue(fields, n, names[4], histogram->maxUs / 1000.0);
+}
+
+/**
+ * @brief Lists every field of stats and the metrics derived from them, in report order.
+ *
+ * @return The number of fields.
+ */
+static int collectFields(Field *fields)
+{
+    static const char *ackNames[5] = {"ackLatencySamples", "ackLatencyP50Ms", "ackLatencyP90Ms",
+                                      "ackLatencyP99Ms", "ackLatencyMaxMs"};
+    static const char *setNames[5] = {"setLatencySamples", "setLatencyP50Ms", "setLatencyP90Ms",
+                                      "setLatencyP99Ms", "setLatencyMaxMs"};
+    static const char *discNames[5] = {"discLatencySamples", "discLatencyP50Ms", "discLatencyP90Ms",
+                                       "discLatencyP99Ms", "discLatencyMaxMs"};
+    int n = 0;
+    double throughput = calculateThroughput();
+    int totalFramesReceived = stats.framesReceivedCorrectly + stats.bcc1Errors + stats.bcc2Errors + stats.duplicateFrames;
+
+    addCount(fields, &n, "baudRate", stats.baudRate);
+    addCount(fields, &n, "totalDataBytes", stats.totalDataBytes);
+    addValue(fields, &n, "transferTimeS", stats.endTime - stats.startTime);
+    addValue(fields, &n, "throughputBps", throughput);
+    addValue(fields, &n, "efficiency", stats.baudRate > 0 ? throughput / stats.baudRate : 0);
+    addCount(fields, &n, "filesTransferred", stats.filesTransferred);
+    addCount(fields, &n, "packetsShared", stats.packetsShared);
+
+    addCount(fields, &n, "framesTransmitted", stats.framesTransmitted);
+    addCount(fields, &n, "framesReceivedCorrectly", stats.framesReceivedCorrectly);
+    addCount(fields, &n, "totalFramesReceived", totalFramesReceived);
+    addCount(fields, &n, "iFrameBytes", stats.iFrameBytes);
+    addValue(fields, &n, "frameErrorRate", calculateFER());
+
+    addCount(fields, &n, "bcc1Errors", stats.bcc1Errors);
+    addCount(fields, &n, "bcc2Errors", stats.bcc2Errors);
+    addCount(fields, &n, "duplicateFrames", stats.duplicateFrames);
+    addCount(fields, &n, "framesRetransmitted", stats.framesRetransmitted);
+    addCount(fields, &n, "timeouts", stats.timeouts);
+    addCount(fields, &n, "rejSent", stats.rejSent);
+    addCount(fields, &n, "rejReceived", stats.rejReceived);
+    addValue(fields, &n, "retransmissionRate",
+             stats.framesTransmitted > 0 ? (double)stats.framesRetransmitted / stats.framesTransmitted : 0);
+
+    addCount(fields, &n, "compressionThreads", stats.compressionThreads);
+    addCount(fields, &n, "packetsCompressed", stats.packetsCompressed);
+    addCount(fields, &n, "compressedInputBytes", stats.compressedInputBytes);
+    addCount(fields, &n, "payloadBytes", stats.payloadBytes);
+    addValue(fields, &n, "compressionRatio",
+             stats.payloadBytes > 0 ? (double)stats.totalDataBytes / stats.payloadBytes : 0);
+
+    addCount(fields, &n, "deltaBlocks", stats.deltaBlocks);
+    addCount(fields, &n, "deltaReusedBytes", stats.deltaReusedBytes);
+
+    addCount(fields, &n, "wireBytes", stats.wireBytes);
+    addCount(fields, &n, "wirePayloadBytes", stats.wirePayloadBytes);
+    addCount(fields, &n, "wireHeaderBytes", stats.wireHeaderBytes);
+    addCount(fields, &n, "wireStuffingBytes", stats.wireStuffingBytes);
+    addCount(fields, &n, "wireFcsBytes", stats.wireFcsBytes);
+    addCount(fields, &n, "wireRetransmittedBytes", stats.wireRetransmittedBytes);
+    addValue(fields, &n, "ackWaitMs", stats.ackWaitMs);
+
+    addCount(fields, &n, "rttSamples", stats.rttSamples);
+    addValue(fields, &n, "srttMs", stats.srttMs);
+    addValue(fields, &n, "rttVarMs", stats.rttVarMs);
+    addCount(fields, &n, "rtoMs", stats.rtoMs);
+
+    addLatency(fields, &n, ackNames, &stats.ackLatency);
+    addLatency(fields, &n, setNames, &stats.setLatency);
+    addLatency(fields, &n, discNames, &stats.discLatency);
+
+    // Always present (0 without LL_PROFILE), so every row of a CSV has the same columns
+    static const char *wallNames[PROF_PHASES] = {"setupWallMs", "transferWallMs", "teardownWallMs",
+                                                 "framingWallMs", "ioWaitWallMs", "fileIoWallMs"};
+    static const char *cpuNames[PROF_PHASES] = {"setupCpuMs", "transferCpuMs", "teardownCpuMs",
+                                                "framingCpuMs", "ioWaitCpuMs", "fileIoCpuMs"};
+    for (int phase = 0; phase < PROF_PHASES; phase++) {
+        const PhaseProfile *profile = phaseProfile(phase);
+        addValue(fields, &n, wallNames[phase], profile->wallMs);
+        addValue(fields, &n, cpuNames[phase], profile->userMs + profile->sysMs);
+    }
+    const PhaseProfile *transfer = phaseProfile(PROF_TRANSFER);
+    long long bytes = (stats.totalDataBytes > 0) ? stats.totalDataBytes : 1;
+    addValue(fields, &n, "cpuNsPerByte", (transfer->userMs + transfer->sysMs) * 1e6 / bytes);
+    addValue(fields, &n, "cyclesPerByte", (double)transfer->counters[PROF_CYCLES] / bytes);
+    addValue(fields, &n, "instructionsPerByte", (double)transfer->counters[PROF_INSTRUCTIONS] / bytes);
+    return n;
+}
+
+static void printField(FILE *file, const Field *field)
+{
+    if (field->integer) fprintf(file, "%lld", field->count);
+    else fprintf(file, "%.6f", field->value);
+}
+
+static int writeJson(FILE *file, const char *role, const Field *fields, int n)
+{
+    fprintf(file, "{\n  \"role\": \"%s\",\n", role);
+    for (int i = 0; i < n; i++) {
+        fprintf(file, "  \"%s\": ", fields[i].name);
+        printField(file, &fields[i]);
+        fprintf(file, ",\n");
+    }
+
+    fprintf(file, "  \"sampleIntervalMs\": %d,\n  \"series\": [", intervalMs);
+    for (int i = 0; i < sampleCount; i++) {
+        const Sample *s = &samples[i];
+        fprintf(file, "%s\n    {\"t\": %.3f, \"iFrameBytes\": %lld, \"throughputBps\": %.1f, \"framesTransmitted\": %d, "
+                "\"framesRetransmitted\": %d, \"timeouts\": %d, \"rej\": %d, \"errors\": %d}",
+                i > 0 ? "," : "", s->t, s->bytes, intervalThroughput(i), s->frames, s->retransmitted,
+                s->timeouts, s->rej, s->errors);
+    }
+    fprintf(file, "%s]\n}\n", sampleCount > 0 ? "\n  " : "");
+    return 0;
+}
+
+static int writeCsv(FILE *file, const char *role, const Field *fields, int n)
+{
+    // Header only for a new file, so the runs of an experiment share one table
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        fprintf(file, "role");
+        for (int i = 0; i < n; i++) fprintf(file, ",%s", fields[i].name);
+        fprintf(file, "\n");
+    }
+    fprintf(file, "%s", role);
+    for (int i = 0; i < n; i++) {
+        fprintf(file, ",");
+        printField(file, &fields[i]);
+    }
+    fprintf(file, "\n");
+    return 0;
+}
+
+/**
+ * @brief Writes the time series of a CSV export to "<name>-series.csv" (replaced each run).
+ */
+static int writeCsvSeries(const char *path)
+{
+    char seriesPath[1024];
+    int base = strlen(path) - 4;    // Without ".csv"
+    if (snprintf(seriesPath, sizeof(seriesPath), "%.*s-series.csv", base, path) >= (int)sizeof(seriesPath)) return -1;
+
+    FILE *file = fopen(seriesPath, "w");
+    if (file == NULL) {
+        perror(seriesPath);
+        return -1;
+    }
+    fprintf(file, "t,iFrameBytes,throughputBps,framesTransmitted,framesRetransmitted,timeouts,rej,errors\n");
+    for (int i = 0; i < sampleCount; i++) {
+        const Sample *s = &samples[i];
+        fprintf(file, "%.3f,%lld,%.1f,%d,%d,%d,%d,%d\n", s->t, s->bytes, intervalThroughput(i), s->frames,
+                s->retransmitted, s->timeouts, s->rej, s->errors);
+    }
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+int exportStatistics(const char *role)
+{
+    if (exportPath == NULL) return 0;
+
+    Field fields[MAX_FIELDS];
+    int n = collectFields(fields);
+
+    size_t length = strlen(exportPath);
+    bool csv = length > 4 && strcmp(exportPath + length - 4, ".csv") == 0;
+
+    FILE *file = fopen(exportPath, csv ? "a" : "w");
+    if (file == NULL) {
+        perror(exportPath);
+        return -1;
+    }
+    int result = csv ? writeCsv(file, role, fields, n) : writeJson(file, role, fields, n);
+    if (fclose(file) != 0) result = -1;
+    if (csv && intervalMs > 0 && writeCsvSeries(exportPath) < 0) result = -1;
+
+    if (result == 0) printf("STATS: Written to %s\n", exportPath);
+    else printf("STATS: ERROR -> Failed to write %s\n", exportPath);
+
+    free(samples);
+    samples = NULL;
+    sampleCount = sampleCapacity = 0;
+    return result;
+}
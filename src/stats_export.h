@@ -0,0 +1,38 @@
+// Machine-readable export of the statistics.
+// With LL_STATS_FILE=path the whole Statistics struct, the derived metrics of
+// the report (throughput, efficiency, FER, ...) and the latency percentiles
+// are written to path when the transfer ends: as JSON, or as CSV if the name
+// ends in ".csv". A CSV file gets one row per run (the header only when the
+// file is new), so the runs of an experiment build one table.
+//
+// With LL_STATS_INTERVAL=ms a sample of the counters is also taken every ms
+// milliseconds of the transfer: the JSON gets a "series" array and a CSV file
+// a "<name>-series.csv" next to it, with the throughput of each interval.
+// Samples are taken by the link layer between frames (see llopen), so the
+// counters are never read by another thread.
+
+#ifndef _STATS_EXPORT_H_
+#define _STATS_EXPORT_H_
+
+// Smallest LL_STATS_INTERVAL accepted
+#define MIN_STATS_INTERVAL_MS 10
+
+// Read LL_STATS_FILE and LL_STATS_INTERVAL (called by initStatistics).
+void initStatsExport();
+
+// Sampling period in milliseconds, or 0 without a time series.
+int statsSampleIntervalMs();
+
+// Drop the samples taken so far: the transfer starts now (markTransferStart).
+void startStatsSeries();
+
+// Take a sample of the counters, unless the transfer already ended.
+void sampleStatistics();
+
+// Take the last sample, at stats.endTime (markTransferEnd).
+void endStatsSeries();
+
+// Write the file named in LL_STATS_FILE, if any. Returns 0 on success or -1 on error.
+int exportStatistics(const char *role);
+
+#endif // _STATS_EXPORT_H_
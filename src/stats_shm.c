@@ -0,0 +1,83 @@
+// Live statistics implementation
+
+#include "stats_shm.h"
+#include "statistics.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static StatsSegment *segment = NULL;
+static LiveState liveState = LIVE_CONNECTING;
+
+void initStatsShm(const char *role)
+{
+    const char *path = getenv("LL_STATS_SHM");
+    if (path == NULL || path[0] == '\0') return;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("LL_STATS_SHM");
+        return;
+    }
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, sizeof(StatsSegment)) == 0) {
+        memory = mmap(NULL, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (memory == MAP_FAILED) perror("LL_STATS_SHM");
+    close(fd);
+    if (memory == MAP_FAILED) return;
+
+    segment = memory;
+    segment->version = STATS_SHM_VERSION;
+    segment->countersSize = sizeof(LiveCounters);
+    segment->pid = getpid();
+    strncpy(segment->role, role, sizeof(segment->role) - 1);
+    // The magic last: a reader that finds it finds the rest of the header too
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(segment->magic, STATS_SHM_MAGIC, sizeof(segment->magic));
+    liveState = LIVE_CONNECTING;
+    publishStatistics();
+}
+
+void publishStatistics()
+{
+    if (segment == NULL) return;
+
+    LiveCounters counters = {
+        .state = liveState,
+        .baudRate = stats.baudRate,
+        .startTime = stats.startTime,
+        .progressBytes = stats.progressBytes,
+        .progressTotal = stats.progressTotal,
+        .iFrameBytes = stats.iFrameBytes,
+        .wireBytes = stats.wireBytes,
+        .wireRetransmittedBytes = stats.wireRetransmittedBytes,
+        .framesTransmitted = stats.framesTransmitted,
+        .framesReceivedCorrectly = stats.framesReceivedCorrectly,
+        .framesRetransmitted = stats.framesRetransmitted,
+        .timeouts = stats.timeouts,
+        .rejSent = stats.rejSent,
+        .rejReceived = stats.rejReceived,
+        .bcc1Errors = stats.bcc1Errors,
+        .bcc2Errors = stats.bcc2Errors,
+        .duplicateFrames = stats.duplicateFrames,
+        .rtoMs = stats.rtoMs,
+        .srttMs = stats.srttMs,
+    };
+
+    // Sequence lock: odd, copy, even (one writer, the main thread)
+    uint32_t sequence = segment->sequence;
+    __atomic_store_n(&segment->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    segment->counters = counters;
+    __atomic_store_n(&segment->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void setLiveState(LiveState state)
+{
+    liveState = state;
+    publishStatistics();
+}
@@ -0,0 +1,71 @@
+// Live statistics for external monitors (LL_STATS_SHM=path).
+// The counters of Statistics that a monitor needs are published in a shared
+// mapping of path (e.g. /dev/shm/ll-tx.stats): a versioned header followed by a
+// LiveCounters record. The link layer publishes them between frames with a
+// sequence lock: the sequence is odd while the record is being copied, so a
+// reader copies it and retries if the sequence was odd or changed. Publishing
+// is a ~150-byte copy and two stores, with no system call and no lock;
+// readers only map the file read-only (see tools/statwatch.c), so they never
+// slow the transfer down.
+
+#ifndef _STATS_SHM_H_
+#define _STATS_SHM_H_
+
+#include <stdint.h>
+
+#define STATS_SHM_MAGIC "LLSTATS1"
+#define STATS_SHM_VERSION 1
+
+typedef enum
+{
+    LIVE_CONNECTING,    // In llopen
+    LIVE_TRANSFER,
+    LIVE_CLOSING,       // In llclose
+    LIVE_DONE,          // Statistics printed, the program is ending
+} LiveState;
+
+typedef struct
+{
+    uint32_t state;             // LiveState
+    int32_t baudRate;
+    double startTime;           // stats.startTime (gettimeofday, seconds)
+    long long progressBytes;    // File bytes sent or received so far
+    long long progressTotal;    // File size (all the files of a batch)
+    long long iFrameBytes;
+    long long wireBytes;
+    long long wireRetransmittedBytes;
+    int32_t framesTransmitted;
+    int32_t framesReceivedCorrectly;
+    int32_t framesRetransmitted;
+    int32_t timeouts;
+    int32_t rejSent;
+    int32_t rejReceived;
+    int32_t bcc1Errors;
+    int32_t bcc2Errors;
+    int32_t duplicateFrames;
+    int32_t rtoMs;
+    double srttMs;
+} LiveCounters;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;           // STATS_SHM_VERSION
+    uint32_t countersSize;      // sizeof(LiveCounters)
+    uint32_t sequence;          // Odd while counters is being written
+    int32_t pid;                // Of the program publishing
+    char role[4];               // "tx" or "rx"
+    char reserved[36];
+    LiveCounters counters;
+} StatsSegment;
+
+// Map the file named in LL_STATS_SHM, if any. role is "tx" or "rx".
+void initStatsShm(const char *role);
+
+// Copy the counters of stats into the segment (no-op without LL_STATS_SHM).
+void publishStatistics();
+
+// Record the phase of the connection and publish.
+void setLiveState(LiveState state);
+
+#endif // _STATS_SHM_H_
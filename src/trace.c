@@ -0,0 +1,144 @@
+// Tracing implementation
+
+#include "trace.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+int traceLevel = TRACE_LEVEL_INFO;
+
+static TraceHeader *header = NULL;
+static TraceEvent *ring = NULL;
+static uint64_t startNs = 0;
+static double lastProgressMs = -1e9;
+
+static const char *eventNames[EV_COUNT] = {
+    [EV_NONE] = "none",
+    [EV_I_SENT] = "I_SENT",
+    [EV_I_RETRANSMITTED] = "I_RETRANSMITTED",
+    [EV_RR_RECEIVED] = "RR_RECEIVED",
+    [EV_REJ_RECEIVED] = "REJ_RECEIVED",
+    [EV_SREJ_RECEIVED] = "SREJ_RECEIVED",
+    [EV_TIMEOUT] = "TIMEOUT",
+    [EV_REPLY_RECEIVED] = "REPLY_RECEIVED",
+    [EV_I_RECEIVED] = "I_RECEIVED",
+    [EV_I_BUFFERED] = "I_BUFFERED",
+    [EV_REJ_SENT] = "REJ_SENT",
+    [EV_SREJ_SENT] = "SREJ_SENT",
+    [EV_HEADER_ERROR] = "HEADER_ERROR",
+    [EV_FCS_ERROR] = "FCS_ERROR",
+    [EV_DUPLICATE] = "DUPLICATE",
+    [EV_OUT_OF_SEQUENCE] = "OUT_OF_SEQUENCE",
+    [EV_REPLY_SENT] = "REPLY_SENT",
+    [EV_SET] = "SET",
+    [EV_UA] = "UA",
+    [EV_DISC] = "DISC",
+    [EV_PACKET_SENT] = "PACKET_SENT",
+    [EV_PACKET_RECEIVED] = "PACKET_RECEIVED",
+};
+
+static uint64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#if TRACE_EVENTS
+/**
+ * @brief Maps the header and the ring: onto the trace file if one is named, in memory otherwise.
+ *
+ * @return The mapping, or NULL on error.
+ */
+static void *mapRing(const char *path, size_t size)
+{
+    if (path == NULL || path[0] == '\0') {
+        void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (memory == MAP_FAILED) ? NULL : memory;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("LL_TRACE_FILE");
+        return NULL;
+    }
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (memory == MAP_FAILED) perror("LL_TRACE_FILE");
+    close(fd);
+    return (memory == MAP_FAILED) ? NULL : memory;
+}
+#endif
+
+void initTrace(const char *role)
+{
+    const char *level = getenv("LL_LOG");
+    if (level != NULL) {
+        if (strcmp(level, "none") == 0) traceLevel = TRACE_LEVEL_NONE;
+        else if (strcmp(level, "error") == 0) traceLevel = TRACE_LEVEL_ERROR;
+        else if (strcmp(level, "info") == 0) traceLevel = TRACE_LEVEL_INFO;
+        else if (strcmp(level, "frame") == 0) traceLevel = TRACE_LEVEL_FRAME;
+        else fprintf(stderr, "LL_LOG: unknown level \"%s\" (none, error, info, frame)\n", level);
+    }
+
+#if TRACE_EVENTS
+    size_t size = sizeof(TraceHeader) + (size_t)TRACE_RING_EVENTS * sizeof(TraceEvent);
+    header = mapRing(getenv("LL_TRACE_FILE"), size);
+    if (header == NULL) return;
+
+    ring = (TraceEvent *)(header + 1);
+    memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+    header->eventSize = sizeof(TraceEvent);
+    header->capacity = TRACE_RING_EVENTS;
+    header->next = 0;
+    header->startRealtimeNs = clockNs(CLOCK_REALTIME);
+    strncpy(header->role, role, sizeof(header->role) - 1);
+    startNs = clockNs(CLOCK_MONOTONIC);
+#endif
+}
+
+/**
+ * @brief Records an event in the next position of the ring.
+ *
+ * The position is claimed with an atomic add, so threads never wait for each
+ * other. The sequence is written last (release): a reader skips a record whose
+ * sequence is 0 or does not match its position, i.e. one still being written
+ * or already overwritten by a newer lap of the ring.
+ */
+void traceEvent(TraceEventId id, int ns, int nr, uint32_t size, uint32_t value)
+{
+    if (ring == NULL) return;
+
+    uint64_t position = __atomic_fetch_add(&header->next, 1, __ATOMIC_RELAXED);
+    TraceEvent *event = &ring[position & (TRACE_RING_EVENTS - 1)];
+
+    __atomic_store_n(&event->sequence, 0, __ATOMIC_RELAXED);
+    event->timeNs = clockNs(CLOCK_MONOTONIC) - startNs;
+    event->id = id;
+    event->ns = ns;
+    event->nr = nr;
+    event->size = size;
+    event->value = value;
+    __atomic_store_n(&event->sequence, (uint32_t)(position + 1), __ATOMIC_RELEASE);
+}
+
+void traceProgress(const char *who, long long done, long long total)
+{
+    if (TRACE_MAX_LEVEL < TRACE_LEVEL_INFO || traceLevel < TRACE_LEVEL_INFO) return;
+
+    double now = clockNs(CLOCK_MONOTONIC) / 1e6;
+    if (done < total && now - lastProgressMs < TRACE_PROGRESS_MS) return;
+    lastProgressMs = now;
+    printf("%s: Progress: %lld/%lld bytes (%.1f%%)\n", who, done, total, total > 0 ? done * 100.0 / total : 100.0);
+}
+
+const char *traceEventName(int id)
+{
+    if (id < 0 || id >= EV_COUNT || eventNames[id] == NULL) return "?";
+    return eventNames[id];
+}
@@ -0,0 +1,135 @@
+// Tracing: console log levels and an in-memory ring of binary events.
+// Console lines go through logError/logInfo/logFrame and are printed up to the
+// level chosen with LL_LOG (error, info or frame; default info). Every frame
+// and packet is also recorded in a ring of the last TRACE_RING_EVENTS events:
+// a fixed-size record (time, event, Ns/Nr, sizes) claimed with one atomic
+// add, so threads record without locks and nothing is formatted on the hot
+// path. With LL_TRACE_FILE=path the ring is a shared mapping of that file,
+// so it is on disk whatever way the program ends; tools/trace_decode prints it.
+//
+// Levels above TRACE_MAX_LEVEL are compiled out, and TRACE_EVENTS=0 compiles
+// out the ring (e.g. make CFLAGS="-Wall -DTRACE_MAX_LEVEL=1 -DTRACE_EVENTS=0").
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_LEVEL_NONE  0
+#define TRACE_LEVEL_ERROR 1     // Failures
+#define TRACE_LEVEL_INFO  2     // Connection, transfer phases, progress
+#define TRACE_LEVEL_FRAME 3     // Every frame and packet
+
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL TRACE_LEVEL_FRAME
+#endif
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 1
+#endif
+
+// Events kept in the ring (a power of two)
+#define TRACE_RING_EVENTS (1 << 16)
+
+// Least time between two progress lines
+#define TRACE_PROGRESS_MS 500
+
+// Trace file: a TraceHeader followed by the ring
+#define TRACE_MAGIC "LLTRACE1"
+
+typedef enum
+{
+    EV_NONE,
+    // Link layer, transmitter
+    EV_I_SENT,              // ns, size: frame bytes on the line
+    EV_I_RETRANSMITTED,     // ns, size
+    EV_RR_RECEIVED,         // nr, value: frames released
+    EV_REJ_RECEIVED,        // nr, value: frames resent
+    EV_SREJ_RECEIVED,       // nr
+    EV_TIMEOUT,             // ns: first frame resent, value: RTO after backoff (ms)
+    EV_REPLY_RECEIVED,      // size
+    // Link layer, receiver
+    EV_I_RECEIVED,          // ns, nr: RR sent, size: payload
+    EV_I_BUFFERED,          // ns, nr: expected
+    EV_REJ_SENT,            // nr
+    EV_SREJ_SENT,           // nr
+    EV_HEADER_ERROR,        // nr: asked for
+    EV_FCS_ERROR,           // ns
+    EV_DUPLICATE,           // ns, nr: expected
+    EV_OUT_OF_SEQUENCE,     // ns, nr: expected
+    EV_REPLY_SENT,          // size, value: attempt
+    // Connection
+    EV_SET,                 // value: attempt
+    EV_UA,
+    EV_DISC,
+    // Application layer
+    EV_PACKET_SENT,         // value: packet type, size: packet bytes
+    EV_PACKET_RECEIVED,     // value: packet type, size: packet bytes
+    EV_COUNT
+} TraceEventId;
+
+typedef struct
+{
+    uint64_t timeNs;        // Since the trace started (CLOCK_MONOTONIC)
+    uint32_t sequence;      // Position in the trace + 1; 0 while being written
+    uint16_t id;
+    uint8_t ns;
+    uint8_t nr;
+    uint32_t size;
+    uint32_t value;
+} TraceEvent;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t eventSize;     // sizeof(TraceEvent)
+    uint32_t capacity;      // TRACE_RING_EVENTS
+    uint64_t next;          // Events recorded so far (the next position)
+    uint64_t startRealtimeNs;
+    char role[4];           // "tx" or "rx"
+    char reserved[28];
+} TraceHeader;
+
+// Console level in effect (LL_LOG)
+extern int traceLevel;
+
+// Read LL_LOG and LL_TRACE_FILE and start the ring. role is "tx" or "rx".
+void initTrace(const char *role);
+
+// Record an event (no-op before initTrace).
+void traceEvent(TraceEventId id, int ns, int nr, uint32_t size, uint32_t value);
+
+// Print a progress line, at most every TRACE_PROGRESS_MS (and always the last one).
+void traceProgress(const char *who, long long done, long long total);
+
+// Name of an event, for the decoder.
+const char *traceEventName(int id);
+
+#define TRACE_LOG(level, ...) do { if ((level) <= traceLevel) printf(__VA_ARGS__); } while (0)
+
+#if TRACE_MAX_LEVEL >= TRACE_LEVEL_ERROR
+#define logError(...) TRACE_LOG(TRACE_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define logError(...) ((void)0)
+#endif
+
+#if TRACE_MAX_LEVEL >= TRACE_LEVEL_INFO
+#define logInfo(...) TRACE_LOG(TRACE_LEVEL_INFO, __VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if TRACE_MAX_LEVEL >= TRACE_LEVEL_FRAME
+#define logFrame(...) TRACE_LOG(TRACE_LEVEL_FRAME, __VA_ARGS__)
+#else
+#define logFrame(...) ((void)0)
+#endif
+
+#if TRACE_EVENTS
+#define TRACE_EVENT(id, ns, nr, size, value) traceEvent((id), (ns), (nr), (size), (value))
+#else
+#define TRACE_EVENT(id, ns, nr, size, value) ((void)0)
+#endif
+
+#endif // _TRACE_H_
@@ -0,0 +1,159 @@
+// Write-behind implementation
+
+#define _GNU_SOURCE
+#include "write_behind.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct
+{
+    long long offset;
+    unsigned char *data;
+    int size;
+} WriteSlot;
+
+/*
+ * Blocks live in a ring: slots[head] is the one being written (or the next one),
+ * count blocks follow it. One mutex protects the ring; the writer waits on
+ * slotReady, the receiver on slotFree.
+ */
+static WriteSlot slots[WRITE_QUEUE_SLOTS];
+static int head = 0;
+static int count = 0;
+static bool failed = false;     // A write failed; later blocks are dropped
+static bool stopping = false;
+static bool running = false;
+static int fullWaits = 0;       // Times the receiver found the queue full
+static long long blocksWritten = 0;
+
+static WriteFunction writeFunction = NULL;
+static void *writeContext = NULL;
+
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slotReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t slotFree = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Writer: writes the blocks in order until stopped with an empty queue.
+ */
+static void *writer(void *arg)
+{
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (count == 0 && !stopping) pthread_cond_wait(&slotReady, &lock);
+        if (count == 0) break;
+
+        WriteSlot *slot = &slots[head];
+        bool skip = failed;
+        pthread_mutex_unlock(&lock);
+        int result = skip ? -1 : writeFunction(writeContext, slot->offset, slot->data, slot->size);
+        pthread_mutex_lock(&lock);
+
+        if (result < 0) failed = true;
+        blocksWritten++;
+        head = (head + 1) % WRITE_QUEUE_SLOTS;
+        count--;
+        pthread_cond_broadcast(&slotFree);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+int startWriter(WriteFunction write, void *context, int maxBlockSize)
+{
+    for (int i = 0; i < WRITE_QUEUE_SLOTS; i++) {
+        slots[i].data = malloc(maxBlockSize);
+        if (slots[i].data == NULL) {
+            stopWriter();
+            return -1;
+        }
+    }
+
+    writeFunction = write;
+    writeContext = context;
+    head = count = fullWaits = 0;
+    blocksWritten = 0;
+    failed = stopping = false;
+
+    if (pthread_create(&thread, NULL, writer, NULL) != 0) {
+        perror("pthread_create");
+        stopWriter();
+        return -1;
+    }
+    running = true;
+    return 0;
+}
+
+int queueWrite(long long offset, const unsigned char *data, int size)
+{
+    pthread_mutex_lock(&lock);
+    if (count == WRITE_QUEUE_SLOTS && !failed) {
+        fullWaits++;
+        while (count == WRITE_QUEUE_SLOTS && !failed) pthread_cond_wait(&slotFree, &lock);
+    }
+    if (failed) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+
+    // The slot is past the ones the writer may be using
+    WriteSlot *slot = &slots[(head + count) % WRITE_QUEUE_SLOTS];
+    memcpy(slot->data, data, size);
+    slot->offset = offset;
+    slot->size = size;
+    count++;
+    pthread_cond_signal(&slotReady);
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int flushWrites()
+{
+    pthread_mutex_lock(&lock);
+    while (count > 0) pthread_cond_wait(&slotFree, &lock);
+    int result = failed ? -1 : 0;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+void stopWriter()
+{
+    if (running) {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_signal(&slotReady);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+        running = false;
+        printf("RX: Write-behind: %lld blocks written, queue full %d times\n", blocksWritten, fullWaits);
+    }
+
+    for (int i = 0; i < WRITE_QUEUE_SLOTS; i++) {
+        free(slots[i].data);
+        slots[i].data = NULL;
+    }
+}
+
+/**
+ * @brief Reserves the blocks from the current end of the file up to size.
+ *
+ * FALLOC_FL_KEEP_SIZE leaves the file size alone, so a partial file still
+ * shows how much was written (the receive journal relies on it). File systems
+ * without fallocate are left to allocate as the data arrives.
+ */
+void preallocateFile(FILE *file, long long size)
+{
+    struct stat st;
+    int fd = fileno(file);
+    if (fstat(fd, &st) != 0 || size <= st.st_size) return;
+
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, st.st_size, size - st.st_size) < 0 && errno != EOPNOTSUPP) {
+        perror("fallocate");
+    }
+}
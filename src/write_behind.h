@@ -0,0 +1,36 @@
+// Write-behind for the receiver.
+// Received file data is copied into a bounded queue and written to disk by a
+// writer thread, so llread can go back to the line (and acknowledge the next
+// frame) while the disk catches up. The receiver only waits when the queue is
+// full, and before checking the file at END.
+
+#ifndef _WRITE_BEHIND_H_
+#define _WRITE_BEHIND_H_
+
+#include <stdio.h>
+
+// Blocks waiting to be written
+#define WRITE_QUEUE_SLOTS 32
+
+// Writes one block at a file offset; runs on the writer thread.
+// Returns 0 on success or -1 on error.
+typedef int (*WriteFunction)(void *context, long long offset, const unsigned char *data, int size);
+
+// Start the writer for blocks of up to maxBlockSize bytes. Returns 0 on success or -1 on error.
+int startWriter(WriteFunction write, void *context, int maxBlockSize);
+
+// Copy a block for the given offset into the queue, waiting while it is full.
+// Returns 0 on success or -1 if an earlier write failed.
+int queueWrite(long long offset, const unsigned char *data, int size);
+
+// Wait until every queued block is written. Returns 0 on success or -1 if a write failed.
+int flushWrites();
+
+// Write what is still queued, stop the writer and release the buffers.
+void stopWriter();
+
+// Reserve disk space for the rest of a file that will grow to size bytes, so
+// that a large file is allocated in few extents. The file size is not changed.
+void preallocateFile(FILE *file, long long size);
+
+#endif // _WRITE_BEHIND_H_
@@ -0,0 +1,170 @@
+// Benchmark of the I-frame byte stuffing encoder and frame check sequences.
+// Compares the original buildIFrame loop (BCC2 loop + copy + per-byte stuffing)
+// with the kernels in src/byte_stuffing.c on three kinds of payload, then times
+// each FCS kernel in src/fcs.c against the time the frame takes on the line.
+//
+// Build and run from the project root:
+//   gcc -Wall -o bin/bench_framing tools/bench_framing.c src/byte_stuffing.c src/fcs.c
+//   ./bin/bench_framing [payload_size] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/byte_stuffing.h"
+#include "../src/fcs.h"
+
+#define DEFAULT_PAYLOAD_SIZE 1000
+#define TARGET_BYTES (256L * 1024 * 1024)
+
+// Line rate used as the reference for the FCS cost (8N1: 10 bits per byte)
+#define LINE_BAUD 115200
+
+typedef int (*Encoder)(unsigned char *, const unsigned char *, int, unsigned char *);
+
+// Original buildIFrame data path, kept as the reference
+static int legacyEncoder(unsigned char *dst, const unsigned char *data, int size, unsigned char *bcc)
+{
+    unsigned char bcc2 = 0;
+    for (int i = 0; i < size; i++) {
+        bcc2 ^= data[i];
+    }
+
+    unsigned char *tempBuffer = malloc(size + 1);
+    memcpy(tempBuffer, data, size);
+    tempBuffer[size] = bcc2;
+
+    int idx = 0;
+    for (int i = 0; i < size + 1; i++) {
+        if (tempBuffer[i] == STUFF_FLAG || tempBuffer[i] == STUFF_ESC) {
+            dst[idx++] = STUFF_ESC;
+            dst[idx++] = tempBuffer[i] ^ 0x20;
+        } else {
+            dst[idx++] = tempBuffer[i];
+        }
+    }
+    free(tempBuffer);
+
+    *bcc = bcc2;
+    return idx;
+}
+
+// New buildIFrame data path: payload and BCC2 stuffed in place
+static Encoder kernel;
+static int kernelEncoder(unsigned char *dst, const unsigned char *data, int size, unsigned char *bcc)
+{
+    unsigned char bcc2 = 0;
+    int idx = kernel(dst, data, size, &bcc2);
+    idx += kernel(dst + idx, &bcc2, 1, NULL);
+    *bcc = bcc2;
+    return idx;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *label, Encoder encoder, const unsigned char *payload, int size)
+{
+    unsigned char *frame = malloc(2 * size + 2);
+    unsigned char bcc = 0;
+    long iterations = TARGET_BYTES / size;
+    unsigned long check = 0;
+
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        check += encoder(frame, payload, size, &bcc);
+    }
+    double elapsed = now() - start;
+
+    printf("  %-8s %8.1f ns/frame %9.1f MB/s   (bcc=%02x, %lu bytes out)\n", label,
+           elapsed * 1e9 / iterations, iterations * (double)size / elapsed / 1e6, bcc, check / iterations);
+    free(frame);
+}
+
+static void benchPayload(const char *name, const unsigned char *payload, int size)
+{
+    printf("%s (%d bytes):\n", name, size);
+    run("legacy", legacyEncoder, payload, size);
+
+    kernel = stuffBytesScalar;
+    run("scalar", kernelEncoder, payload, size);
+    kernel = stuffBytesSSE2;
+    run("sse2", kernelEncoder, payload, size);
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = stuffBytesAVX2;
+        run("avx2", kernelEncoder, payload, size);
+    }
+}
+
+typedef unsigned long (*FcsKernel)(const unsigned char *, int);
+
+static unsigned long fcsXor(const unsigned char *data, int size) { return xorChecksum(data, size); }
+static unsigned long fcsCrc16(const unsigned char *data, int size) { return crc16Ccitt(data, size); }
+static unsigned long fcsCrc32cSw(const unsigned char *data, int size) { return crc32cSoftware(data, size); }
+static unsigned long fcsCrc32cHw(const unsigned char *data, int size) { return crc32cHardware(data, size); }
+
+static void runFcs(const char *label, FcsKernel fcs, const unsigned char *payload, int size)
+{
+    long iterations = TARGET_BYTES / size;
+    unsigned long check = 0;
+
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        check ^= fcs(payload, size);
+    }
+    double elapsed = now() - start;
+
+    double frameNs = elapsed * 1e9 / iterations;
+    double lineNs = size * 10.0 / LINE_BAUD * 1e9;
+    printf("  %-11s %8.1f ns/frame %9.1f MB/s   %.5f%% of line time (check=%lx)\n", label,
+           frameNs, iterations * (double)size / elapsed / 1e6, 100.0 * frameNs / lineNs, check);
+}
+
+static void benchFcs(const unsigned char *payload, int size)
+{
+    const unsigned char *vector = (const unsigned char *)"123456789";
+
+    printf("FCS check values: crc16=%04x (29b1) crc32c sw=%08x hw=%08x (e3069283)\n",
+           crc16Ccitt(vector, 9), crc32cSoftware(vector, 9), crc32cHardware(vector, 9));
+    printf("FCS (%d bytes, line time %.1f us at %d baud):\n", size, size * 10.0 / LINE_BAUD * 1e6, LINE_BAUD);
+    runFcs("xor", fcsXor, payload, size);
+    runFcs("crc16", fcsCrc16, payload, size);
+    runFcs("crc32c-sw", fcsCrc32cSw, payload, size);
+    runFcs("crc32c-hw", fcsCrc32cHw, payload, size);
+}
+
+int main(int argc, char *argv[])
+{
+    int size = (argc > 1) ? atoi(argv[1]) : DEFAULT_PAYLOAD_SIZE;
+    const char *path = (argc > 2) ? argv[2] : "penguin.gif";
+    unsigned char *payload = malloc(size);
+
+    printf("Selected kernel: %s\n\n", stuffKernelName());
+
+    srand(1);
+    for (int i = 0; i < size; i++) payload[i] = rand() & 0xFF;
+    benchPayload("random", payload, size);
+    printf("\n");
+    benchFcs(payload, size);
+    printf("\n");
+
+    FILE *file = fopen(path, "rb");
+    if (file != NULL) {
+        int n = fread(payload, 1, size, file);
+        fclose(file);
+        if (n == size) benchPayload(path, payload, size);
+    }
+
+    memset(payload, STUFF_FLAG, size);
+    benchPayload("all 0x7E", payload, size);
+
+    free(payload);
+    return 0;
+}
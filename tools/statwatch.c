@@ -0,0 +1,145 @@
+// Live monitor of a transfer started with LL_STATS_SHM (see src/stats_shm.h).
+// Maps the file read-only and prints, every interval, the progress, the
+// throughput of the last interval and of the whole transfer, retransmissions,
+// errors and the time left at the recent rate. Stops when the transfer ends
+// or the program publishing disappears. It never writes to the segment, so
+// the transfer does not notice it.
+//
+// Build and run from the project root:
+//   gcc -Wall -o bin/statwatch tools/statwatch.c
+//   LL_STATS_SHM=/dev/shm/ll-tx.stats ./bin/main /dev/ttyS10 9600 tx penguin.gif
+//   ./bin/statwatch /dev/shm/ll-tx.stats [interval_ms]
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/stats_shm.h"
+
+// Attempts at a consistent copy before showing the previous one again
+#define READ_ATTEMPTS 1000
+
+static const char *stateNames[] = {"connecting", "transfer", "closing", "done"};
+
+/**
+ * @brief Copies the counters while no update is in progress (sequence lock).
+ *
+ * @return 0 on success, -1 if the writer kept changing them.
+ */
+static int readCounters(const StatsSegment *segment, LiveCounters *counters)
+{
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        uint32_t before = __atomic_load_n(&segment->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) continue;
+        memcpy(counters, (const void *)&segment->counters, sizeof(*counters));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&segment->sequence, __ATOMIC_RELAXED) == before) return 0;
+    }
+    return -1;
+}
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void formatDuration(double seconds, char *out, size_t size)
+{
+    if (seconds < 0) {
+        snprintf(out, size, "--:--");
+        return;
+    }
+    long s = (long)(seconds + 0.5);
+    if (s >= 3600) snprintf(out, size, "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+    else snprintf(out, size, "%02ld:%02ld", s / 60, s % 60);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s stats-file [interval_ms]\n", argv[0]);
+        return 1;
+    }
+    int intervalMs = (argc > 2) ? atoi(argv[2]) : 1000;
+    if (intervalMs < 10) intervalMs = 10;
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(StatsSegment)) {
+        fprintf(stderr, "%s: not a statistics file of this version\n", argv[1]);
+        close(fd);
+        return 1;
+    }
+    const StatsSegment *segment = mmap(NULL, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (memcmp(segment->magic, STATS_SHM_MAGIC, sizeof(segment->magic)) != 0 ||
+        segment->version != STATS_SHM_VERSION || segment->countersSize != sizeof(LiveCounters)) {
+        fprintf(stderr, "%s: not a statistics file of this version\n", argv[1]);
+        return 1;
+    }
+    printf("Watching %.3s (pid %d), every %d ms\n", segment->role, segment->pid, intervalMs);
+    printf("%-10s %9s %17s %6s %11s %11s %7s %7s %7s %8s\n", "state", "elapsed", "bytes", "done",
+           "now bit/s", "avg bit/s", "resent", "errors", "tmouts", "ETA");
+
+    LiveCounters previous, current;
+    memset(&previous, 0, sizeof(previous));
+    double previousAt = nowSeconds();
+    // Recent rate (bytes/s), smoothed over about four intervals for the ETA
+    double rate = 0;
+
+    while (1) {
+        double at = nowSeconds();
+        if (readCounters(segment, &current) < 0) current = previous;
+
+        double dt = at - previousAt;
+        double instant = (dt > 0 && current.progressBytes >= previous.progressBytes)
+                       ? (current.progressBytes - previous.progressBytes) / dt : 0;
+        rate = (rate == 0) ? instant : 0.75 * rate + 0.25 * instant;
+
+        double elapsed = (current.state >= LIVE_TRANSFER && current.startTime > 0) ? at - current.startTime : 0;
+        double average = (elapsed > 0) ? current.iFrameBytes * 8.0 / elapsed : 0;
+        double left = (current.progressTotal > 0 && rate > 0)
+                    ? (current.progressTotal - current.progressBytes) / rate : -1;
+        char elapsedText[16], etaText[16], bytesText[32];
+        formatDuration(elapsed, elapsedText, sizeof(elapsedText));
+        formatDuration(current.state == LIVE_DONE ? 0 : left, etaText, sizeof(etaText));
+        snprintf(bytesText, sizeof(bytesText), "%lld/%lld", current.progressBytes, current.progressTotal);
+
+        printf("%-10s %9s %17s %5.1f%% %11.0f %11.0f %7d %7d %7d %8s\n",
+               current.state <= LIVE_DONE ? stateNames[current.state] : "?", elapsedText, bytesText,
+               current.progressTotal > 0 ? current.progressBytes * 100.0 / current.progressTotal : 0.0,
+               instant * 8, average, current.framesRetransmitted,
+               current.bcc1Errors + current.bcc2Errors, current.timeouts, etaText);
+        fflush(stdout);
+
+        if (current.state == LIVE_DONE) break;
+        if (kill(segment->pid, 0) != 0 && errno == ESRCH) {
+            printf("The program publishing (pid %d) has ended\n", segment->pid);
+            break;
+        }
+
+        previous = current;
+        previousAt = at;
+        struct timespec pause = {intervalMs / 1000, (intervalMs % 1000) * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+// Decoder of the event ring written with LL_TRACE_FILE (see src/trace.h).
+// Prints the events still in the ring, oldest first, with their time since the
+// trace started, then how many of each kind there were. A file left by a
+// program that crashed or was killed is read the same way.
+//
+// Build and run from the project root:
+//   gcc -Wall -o bin/trace_decode tools/trace_decode.c src/trace.c
+//   ./bin/trace_decode trace-tx.bin [-s]     (-s: only the summary)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/trace.h"
+
+// Which fields an event uses (see the comments of TraceEventId)
+#define HAS_NS 1
+#define HAS_NR 2
+#define HAS_SIZE 4
+#define HAS_VALUE 8
+
+static int eventFields(int id)
+{
+    switch (id) {
+        case EV_I_SENT: case EV_I_RETRANSMITTED: return HAS_NS | HAS_SIZE;
+        case EV_RR_RECEIVED: case EV_REJ_RECEIVED: return HAS_NR | HAS_VALUE;
+        case EV_SREJ_RECEIVED: case EV_REJ_SENT: case EV_SREJ_SENT: return HAS_NR;
+        case EV_HEADER_ERROR: return HAS_NR | HAS_SIZE;
+        case EV_TIMEOUT: return HAS_NS | HAS_VALUE;
+        case EV_I_RECEIVED: case EV_I_BUFFERED: case EV_DUPLICATE: case EV_OUT_OF_SEQUENCE:
+            return HAS_NS | HAS_NR | HAS_SIZE;
+        case EV_FCS_ERROR: return HAS_NS | HAS_NR | HAS_SIZE | HAS_VALUE;
+        case EV_REPLY_SENT: case EV_SET: case EV_DISC: return HAS_SIZE | HAS_VALUE;
+        case EV_PACKET_SENT: case EV_PACKET_RECEIVED: return HAS_SIZE | HAS_VALUE;
+        default: return HAS_SIZE;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace-file [-s]\n", argv[0]);
+        return 1;
+    }
+    int summaryOnly = (argc > 2 && strcmp(argv[2], "-s") == 0);
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.eventSize != sizeof(TraceEvent) || header.capacity == 0 ||
+        (header.capacity & (header.capacity - 1)) != 0) {
+        fprintf(stderr, "%s: not a trace file of this version\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    TraceEvent *ring = malloc((size_t)header.capacity * sizeof(TraceEvent));
+    if (ring == NULL || fread(ring, sizeof(TraceEvent), header.capacity, file) != header.capacity) {
+        fprintf(stderr, "%s: truncated trace file\n", argv[1]);
+        free(ring);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    time_t started = header.startRealtimeNs / 1000000000ull;
+    char when[64];
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&started));
+    uint64_t first = (header.next > header.capacity) ? header.next - header.capacity : 0;
+    printf("Trace of %.3s started %s: %llu events, the last %llu kept\n\n", header.role, when,
+           (unsigned long long)header.next, (unsigned long long)(header.next - first));
+
+    long long counts[EV_COUNT] = {0};
+    long long skipped = 0;
+    uint64_t lastNs = 0;
+
+    for (uint64_t position = first; position < header.next; position++) {
+        const TraceEvent *event = &ring[position & (header.capacity - 1)];
+        // Still being written when the program stopped, or overwritten by a later lap
+        if (event->sequence != (uint32_t)(position + 1) || event->id >= EV_COUNT) {
+            skipped++;
+            continue;
+        }
+        counts[event->id]++;
+        lastNs = event->timeNs;
+        if (summaryOnly) continue;
+
+        int fields = eventFields(event->id);
+        printf("%12.3f ms  %-16s", event->timeNs / 1e6, traceEventName(event->id));
+        if (fields & HAS_NS) printf(" Ns=%-3d", event->ns);
+        if (fields & HAS_NR) printf(" Nr=%-3d", event->nr);
+        if (fields & HAS_SIZE) printf(" size=%-6u", event->size);
+        if (fields & HAS_VALUE) printf(" value=%u", event->value);
+        printf("\n");
+    }
+
+    printf("\nSummary (%.3f s", lastNs / 1e9);
+    if (skipped > 0) printf(", %lld incomplete records skipped", skipped);
+    printf("):\n");
+    for (int id = 1; id < EV_COUNT; id++) {
+        if (counts[id] > 0) printf("  %-16s %lld\n", traceEventName(id), counts[id]);
+    }
+
+    free(ring);
+    return 0;
+}